@@ -0,0 +1,294 @@
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One workload at one size, run through one engine.
+struct Result {
+    string workload;
+    string size;
+    string engine;
+    double median;
+    double p90;
+    long peakRss;
+    bool failed;
+};
+
+struct Options {
+    string lambda = "./lambda";
+    string workloads = "bench/workloads.txt";
+    string baseline;
+    string save;
+    vector<string> engines;
+    int runs = 5;
+    int timeout = 60;
+};
+
+void usageError(string msg) {
+    cout << "BENCH ERROR: " << msg << "\n";
+    exit(1);
+}
+
+string readFile(string filename) {
+    ifstream file(filename);
+    if (!file.is_open()) usageError(filename + " not found");
+
+    stringstream data;
+    data << file.rdbuf();
+    return data.str();
+}
+
+string replaceAll(string text, string from, string to) {
+    size_t pos = 0;
+
+    while ((pos = text.find(from, pos)) != string::npos) {
+        text.replace(pos, from.size(), to);
+        pos += to.size();
+    }
+
+    return text;
+}
+
+// Writes the workload with $N replaced by size to a temporary file and
+// returns its name.
+string instantiate(string source, string size) {
+    char name[] = "/tmp/lambda-bench-XXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0) usageError("unable to create a temporary file");
+
+    string program = replaceAll(source, "$N", size);
+    if (write(fd, program.data(), program.size()) != (ssize_t)program.size())
+        usageError("unable to write a temporary file");
+
+    close(fd);
+    return name;
+}
+
+// Runs the interpreter once with its output discarded and returns the wall
+// time in seconds, or a negative time if it failed or ran past the timeout,
+// which is left to an alarm that survives the exec. The peak resident set
+// size of the child is stored in rss (in kilobytes).
+double runOnce(const Options &options, string engine, string file,
+               long &rss) {
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+
+    if (pid == 0) {
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, 1);
+        dup2(devNull, 2);
+        alarm(options.timeout);
+
+        string engineFlag = "--engine=" + engine;
+        execl(options.lambda.c_str(), options.lambda.c_str(),
+              engineFlag.c_str(), file.c_str(), (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) return -1;
+
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+    rss = usage.ru_maxrss;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) return -1;
+    return elapsed.count();
+}
+
+// Nearest-rank percentile of sorted times.
+double percentile(const vector<double> &times, int p) {
+    size_t rank = (times.size() * p + 99) / 100;
+    return times[max(rank, (size_t)1) - 1];
+}
+
+Result measure(const Options &options, string workload, string size,
+               string engine, string file) {
+    Result result = {workload, size, engine, 0, 0, 0, false};
+    vector<double> times;
+
+    for (int i = 0; i < options.runs; i++) {
+        long rss = 0;
+        double time = runOnce(options, engine, file, rss);
+
+        if (time < 0) {
+            result.failed = true;
+            return result;
+        }
+
+        times.push_back(time);
+        result.peakRss = max(result.peakRss, rss);
+    }
+
+    sort(times.begin(), times.end());
+    result.median = percentile(times, 50);
+    result.p90 = percentile(times, 90);
+    return result;
+}
+
+string key(const Result &result) {
+    return result.workload + " " + result.size + " " + result.engine;
+}
+
+// Baseline files hold one result per line:
+// workload size engine median-ms p90-ms peak-rss-kb
+map<string, Result> readBaseline(string filename) {
+    map<string, Result> baseline;
+    stringstream lines(readFile(filename));
+    string line;
+
+    while (getline(lines, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        Result result = {"", "", "", 0, 0, 0, false};
+        stringstream fields(line);
+        fields >> result.workload >> result.size >> result.engine >>
+            result.median >> result.p90 >> result.peakRss;
+        result.median /= 1000;
+        result.p90 /= 1000;
+
+        if (!fields.fail()) baseline[key(result)] = result;
+    }
+
+    return baseline;
+}
+
+void writeBaseline(string filename, const vector<Result> &results) {
+    ofstream file(filename);
+    if (!file.is_open()) usageError("unable to write " + filename);
+
+    file << "# workload size engine median-ms p90-ms peak-rss-kb\n";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        if (results[i].failed) continue;
+
+        char line[256];
+        snprintf(line, sizeof(line), "%s %s %s %.1f %.1f %ld\n",
+                 results[i].workload.c_str(), results[i].size.c_str(),
+                 results[i].engine.c_str(), results[i].median * 1000,
+                 results[i].p90 * 1000, results[i].peakRss);
+        file << line;
+    }
+}
+
+void printResult(const Result &result, const map<string, Result> &baseline) {
+    char line[256];
+
+    if (result.failed) {
+        snprintf(line, sizeof(line), "%-10s %9s %-8s %s\n",
+                 result.workload.c_str(), result.size.c_str(),
+                 result.engine.c_str(), "FAILED");
+        cout << line;
+        return;
+    }
+
+    snprintf(line, sizeof(line), "%-10s %9s %-8s %10.1f %10.1f %10ld",
+             result.workload.c_str(), result.size.c_str(),
+             result.engine.c_str(), result.median * 1000, result.p90 * 1000,
+             result.peakRss);
+    cout << line;
+
+    auto base = baseline.find(key(result));
+
+    if (base != baseline.end() && base->second.median > 0 &&
+        base->second.peakRss > 0) {
+        snprintf(line, sizeof(line), " %9.2fx %9.2fx",
+                 result.median / base->second.median,
+                 (double)result.peakRss / base->second.peakRss);
+        cout << line;
+    }
+
+    cout << endl;
+}
+
+// Workload files list one workload per line: a template file, which is a
+// program with $N standing for the size, followed by the sizes to run it at.
+void runWorkloads(const Options &options) {
+    map<string, Result> baseline;
+    if (!options.baseline.empty()) baseline = readBaseline(options.baseline);
+
+    stringstream lines(readFile(options.workloads));
+    string dir = options.workloads.substr(0, options.workloads.rfind('/') + 1);
+    vector<Result> results;
+    string line;
+
+    char header[256];
+    snprintf(header, sizeof(header), "%-10s %9s %-8s %10s %10s %10s %10s %10s\n",
+             "workload", "size", "engine", "median ms", "p90 ms", "rss kb",
+             "time", "rss");
+    cout << header;
+
+    while (getline(lines, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        stringstream fields(line);
+        string templateFile;
+        string size;
+        fields >> templateFile;
+
+        string source = readFile(dir + templateFile);
+        string workload = templateFile.substr(0, templateFile.rfind('.'));
+
+        while (fields >> size) {
+            string file = instantiate(source, size);
+
+            for (size_t i = 0; i < options.engines.size(); i++) {
+                results.push_back(
+                    measure(options, workload, size, options.engines[i], file));
+                printResult(results.back(), baseline);
+            }
+
+            unlink(file.c_str());
+        }
+    }
+
+    if (!options.save.empty()) writeBaseline(options.save, results);
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg.compare(0, 9, "--lambda=") == 0) {
+            options.lambda = arg.substr(9);
+        } else if (arg.compare(0, 9, "--engine=") == 0) {
+            options.engines.push_back(arg.substr(9));
+        } else if (arg.compare(0, 7, "--runs=") == 0) {
+            options.runs = atoi(arg.substr(7).c_str());
+            if (options.runs < 1) usageError("--runs needs at least 1 run");
+        } else if (arg.compare(0, 10, "--timeout=") == 0) {
+            options.timeout = atoi(arg.substr(10).c_str());
+            if (options.timeout < 1) usageError("--timeout needs at least 1s");
+        } else if (arg.compare(0, 11, "--baseline=") == 0) {
+            options.baseline = arg.substr(11);
+        } else if (arg.compare(0, 7, "--save=") == 0) {
+            options.save = arg.substr(7);
+        } else if (arg[0] != '-') {
+            options.workloads = arg;
+        } else {
+            usageError("unknown option " + arg);
+        }
+    }
+
+    if (options.engines.empty())
+        options.engines = {"subst", "graph", "krivine", "vm"};
+
+    runWorkloads(options);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "bytecode.hh"
+
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+string opcodes[] = {"APPLY", "GRAB", "ACCESS", "GLOBAL", "FREE", "NUMERAL"};
+
+Bytecode::Bytecode(TermStore &store, SymbolTable &symbols, NumeralNames names)
+    : store(store), symbols(symbols) {
+    TermId pred = store.Make(INDEX, 2, NIL_TERM, NIL_TERM);
+
+    zeroCode = Compile(store.ChurchZero(names.f, names.x), "numeral zero");
+    successorCode = Compile(store.ChurchSuccessor(pred, names.f, names.x),
+                            "numeral successor");
+}
+
+void Bytecode::CompileDefinitions(const Definitions &definitions) {
+    const vector<Symbol> &names = definitions.Names();
+
+    for (size_t i = 0; i < names.size(); i++) {
+        globalIndices[names[i]] = globals.size();
+        globals.push_back(0);
+    }
+
+    for (size_t i = 0; i < names.size(); i++)
+        globals[globalIndices[names[i]]] =
+            Compile(definitions.Find(names[i]), symbols.Name(names[i]));
+}
+
+// Compiles the head spine of term in line and each argument as a separate
+// block, patching the APPLY that refers to it once its address is known.
+uint32_t Bytecode::Compile(TermId term, string label) {
+    uint32_t entry = code.size();
+    vector<CodePatch> patches;
+    patches.push_back({term, UINT32_MAX});
+    labels[entry] = label;
+
+    while (!patches.empty()) {
+        CodePatch patch = patches.back();
+        patches.pop_back();
+        term = patch.term;
+
+        if (patch.slot != UINT32_MAX) code[patch.slot] = code.size();
+
+        while (true) {
+            Term t = store[term];
+
+            if (t.type == APPLICATION) {
+                emit(OP_APPLY, 0);
+                patches.push_back({t.rTerm, (uint32_t)code.size() - 1});
+                term = t.lTerm;
+            } else if (t.type == ABSTRACTION) {
+                emit(OP_GRAB, t.var);
+                term = t.lTerm;
+            } else if (t.type == INDEX) {
+                emit(OP_ACCESS, t.var);
+                break;
+            } else if (t.type == NUMERAL) {
+                emit(OP_NUMERAL, term);
+                break;
+            } else {
+                auto global = globalIndices.find(t.var);
+
+                if (global != globalIndices.end())
+                    emit(OP_GLOBAL, global->second);
+                else
+                    emit(OP_FREE, t.var);
+                break;
+            }
+        }
+    }
+
+    return entry;
+}
+
+// Drops the code from size on, such as a statement compiled last that has
+// been run.
+void Bytecode::Truncate(uint32_t size) {
+    code.resize(size);
+    labels.erase(labels.lower_bound(size), labels.end());
+}
+
+void Bytecode::Disassemble(uint32_t from) {
+    vector<Symbol> globalNames(globals.size());
+    for (auto &global : globalIndices) globalNames[global.second] = global.first;
+
+    for (uint32_t pc = from; pc < code.size(); pc += INSTRUCTION_SIZE) {
+        auto label = labels.find(pc);
+        if (label != labels.end()) cout << label->second << ":\n";
+
+        Opcode op = (Opcode)code[pc];
+        uint32_t operand = code[pc + 1];
+        cout << setw(8) << pc << "  " << left << setw(8) << opcodes[op]
+             << right;
+
+        if (op == OP_GRAB || op == OP_FREE)
+            cout << symbols.Name(operand);
+        else if (op == OP_GLOBAL)
+            cout << symbols.Name(globalNames[operand]);
+        else if (op == OP_NUMERAL)
+            cout << store.NumeralValue(operand);
+        else
+            cout << operand;
+
+        cout << "\n";
+    }
+}
+
+uint32_t Bytecode::Global(uint32_t index) { return globals[index]; }
+
+size_t Bytecode::GlobalCount() { return globals.size(); }
+
+uint32_t Bytecode::ZeroCode() { return zeroCode; }
+
+uint32_t Bytecode::SuccessorCode() { return successorCode; }
+
+void Bytecode::emit(Opcode op, uint32_t operand) {
+    code.push_back(op);
+    code.push_back(operand);
+}
\ No newline at end of file
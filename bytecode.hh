@@ -0,0 +1,70 @@
+#ifndef __BYTECODE_H__
+#define __BYTECODE_H__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "definitions.hh"
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+// Each instruction is an opcode word followed by one operand word.
+//
+// APPLY pushes a closure of the argument code at its operand over the
+// current environment and continues with the function, which follows it.
+// GRAB binds the closure on top of the stack, or returns the abstraction as
+// a closure if there is none; its operand is the bound name. ACCESS jumps to
+// the closure at its operand's De Bruijn index in the environment, GLOBAL to
+// the definition with its operand's index and FREE returns an unbound name.
+// NUMERAL returns the compact numeral whose term id is its operand, or
+// unfolds it into the zero or successor code if it is being applied.
+typedef enum {
+    OP_APPLY = 0,
+    OP_GRAB,
+    OP_ACCESS,
+    OP_GLOBAL,
+    OP_FREE,
+    OP_NUMERAL
+} Opcode;
+
+const uint32_t INSTRUCTION_SIZE = 2;
+
+struct CodePatch {
+    TermId term;
+    uint32_t slot;
+};
+
+// Lowers terms to Krivine machine bytecode. Definitions are compiled once
+// into a table of globals that every compiled statement refers to by index.
+class Bytecode {
+   public:
+    Bytecode(TermStore &store, SymbolTable &symbols, NumeralNames names);
+    void CompileDefinitions(const Definitions &definitions);
+    uint32_t Compile(TermId term, string label);
+    void Truncate(uint32_t size);
+    void Disassemble(uint32_t from = 0);
+    uint32_t Global(uint32_t index);
+    size_t GlobalCount();
+    uint32_t ZeroCode();
+    uint32_t SuccessorCode();
+
+    uint32_t operator[](uint32_t pc) { return code[pc]; }
+
+   private:
+    TermStore &store;
+    SymbolTable &symbols;
+    vector<uint32_t> code;
+    vector<uint32_t> globals;
+    map<Symbol, uint32_t> globalIndices;
+    map<uint32_t, string> labels;
+    uint32_t zeroCode;
+    uint32_t successorCode;
+
+    void emit(Opcode op, uint32_t operand);
+};
+
+#endif
@@ -0,0 +1,13 @@
+#include "definitions.hh"
+
+#include <vector>
+
+using namespace std;
+
+void Definitions::Set(Symbol name, TermId term) {
+    if (name >= terms.size()) terms.resize(name + 1, NIL_TERM);
+    if (terms[name] == NIL_TERM) names.push_back(name);
+    terms[name] = term;
+}
+
+const vector<Symbol> &Definitions::Names() const { return names; }
\ No newline at end of file
@@ -0,0 +1,31 @@
+#ifndef __DEFINITIONS_H__
+#define __DEFINITIONS_H__
+
+#include <vector>
+
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+// The terms bound by let, indexed by the symbol of their name so that a
+// lookup during reduction is an array access. Names are also kept in the
+// order they were first defined, for the passes over every definition.
+// Definitions are only added while parsing, before anything reads them from
+// another thread.
+class Definitions {
+   public:
+    void Set(Symbol name, TermId term);
+    const vector<Symbol> &Names() const;
+
+    // The term bound to name, or NIL_TERM if it has no definition.
+    TermId Find(Symbol name) const {
+        return name < terms.size() ? terms[name] : NIL_TERM;
+    }
+
+   private:
+    vector<TermId> terms;
+    vector<Symbol> names;
+};
+
+#endif
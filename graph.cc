@@ -0,0 +1,442 @@
+#include "graph.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+GraphReducer::GraphReducer(TermStore &store, const Definitions &definitions,
+                           NumeralNames names)
+    : store(store), definitions(definitions), names(names) {
+    epoch = 0;
+}
+
+TermId GraphReducer::Normalize(TermId term) {
+    vector<GraphNode *> vars;
+    GraphNode *node = normalize(toGraph(term, vars));
+    TermId result = toTerm(node);
+
+    nodes.clear();
+    sharedDefs.clear();
+    return result;
+}
+
+const Stats &GraphReducer::Statistics() { return stats; }
+
+GraphNode *GraphReducer::newNode(NodeType type, Symbol name,
+                                 GraphNode *lNode, GraphNode *rNode) {
+    nodes.emplace_back();
+    GraphNode *node = &nodes.back();
+    node->type = type;
+    node->name = name;
+    node->lNode = lNode;
+    node->rNode = rNode;
+    node->copy = NULL;
+    node->stamp = nodes.size();
+    node->epoch = 0;
+    node->depth = 0;
+    node->level = 0;
+    node->normal = false;
+    return node;
+}
+
+// Follows indirections, pointing every node on the way straight at the
+// end of the chain so long chains are only walked once.
+GraphNode *GraphReducer::follow(GraphNode *node) {
+    GraphNode *target = node;
+    while (target->type == G_IND) target = target->lNode;
+
+    while (node->type == G_IND && node->lNode != target) {
+        GraphNode *next = node->lNode;
+        node->lNode = target;
+        node = next;
+    }
+
+    return target;
+}
+
+GraphNode *GraphReducer::toGraph(TermId term, vector<GraphNode *> &vars) {
+    vector<pair<TermId, bool>> visits;
+    vector<GraphNode *> results;
+    visits.push_back({term, false});
+
+    while (!visits.empty()) {
+        TermId id = visits.back().first;
+        bool expanded = visits.back().second;
+        visits.pop_back();
+        Term t = store[id];
+        GraphNode *lNode;
+        GraphNode *rNode;
+
+        if (expanded) {
+            rNode = results.back();
+            results.pop_back();
+
+            if (t.type == ABSTRACTION) {
+                results.push_back(newNode(G_LAM, t.var, rNode, vars.back()));
+                vars.pop_back();
+            } else {
+                lNode = results.back();
+                results.pop_back();
+                results.push_back(newNode(G_APP, 0, lNode, rNode));
+            }
+
+            continue;
+        }
+
+        switch (t.type) {
+            case ABSTRACTION:
+                vars.push_back(newNode(G_VAR, t.var, NULL, NULL));
+                visits.push_back({id, true});
+                visits.push_back({t.lTerm, false});
+                break;
+            case APPLICATION:
+                visits.push_back({id, true});
+                visits.push_back({t.rTerm, false});
+                visits.push_back({t.lTerm, false});
+                break;
+            case INDEX:
+                results.push_back(vars[vars.size() - 1 - t.var]);
+                break;
+            case NUMERAL:
+                results.push_back(newNode(G_NUM, id, NULL, NULL));
+                break;
+            default:
+                if (definitions.Find(t.var) != NIL_TERM)
+                    results.push_back(newNode(G_DEF, t.var, NULL, NULL));
+                else
+                    results.push_back(newNode(G_FREE, t.var, NULL, NULL));
+                break;
+        }
+    }
+
+    return results.back();
+}
+
+// Definitions are closed, so one graph can serve every use of a definition
+// in the statement and its reductions are shared as well. Recursive
+// definitions get a fresh graph per use to keep the graph acyclic.
+GraphNode *GraphReducer::definition(Symbol name) {
+    vector<GraphNode *> vars;
+    TermId term = definitions.Find(name);
+
+    if (isRecursive(name)) return toGraph(term, vars);
+
+    auto shared = sharedDefs.find(name);
+    if (shared != sharedDefs.end()) return shared->second;
+
+    GraphNode *node = toGraph(term, vars);
+    sharedDefs[name] = node;
+    return node;
+}
+
+bool GraphReducer::isRecursive(Symbol name) {
+    auto known = recursiveDefs.find(name);
+    if (known != recursiveDefs.end()) return known->second;
+
+    map<Symbol, bool> found;
+    vector<Symbol> pending;
+    pending.push_back(name);
+
+    while (!pending.empty()) {
+        Symbol next = pending.back();
+        pending.pop_back();
+
+        map<Symbol, bool> refs;
+        findDefs(definitions.Find(next), refs);
+
+        for (auto i = refs.begin(); i != refs.end(); i++) {
+            if (found.find(i->first) != found.end()) continue;
+            found[i->first] = true;
+            pending.push_back(i->first);
+        }
+    }
+
+    recursiveDefs[name] = found.find(name) != found.end();
+    return recursiveDefs[name];
+}
+
+void GraphReducer::findDefs(TermId term, map<Symbol, bool> &found) {
+    vector<TermId> pending;
+    pending.push_back(term);
+
+    while (!pending.empty()) {
+        Term t = store[pending.back()];
+        pending.pop_back();
+
+        if (t.type == PRIMARY && definitions.Find(t.var) != NIL_TERM)
+            found[t.var] = true;
+
+        if (t.type == NUMERAL) continue;
+        if (t.lTerm != NIL_TERM) pending.push_back(t.lTerm);
+        if (t.rTerm != NIL_TERM) pending.push_back(t.rTerm);
+    }
+}
+
+// Reduces node to weak head normal form. The applications along the left
+// spine are kept on an explicit stack; each one whose function is an
+// abstraction is overwritten with an indirection to its value.
+GraphNode *GraphReducer::whnf(GraphNode *node) {
+    vector<GraphNode *> spine;
+
+    while (true) {
+        node = follow(node);
+
+        if (node->type == G_APP) {
+            spine.push_back(node);
+            node = node->lNode;
+        } else if (node->type == G_DEF) {
+            node->lNode = definition(node->name);
+            node->type = G_IND;
+            stats.unfoldings++;
+        } else if (node->type == G_NUM && !spine.empty()) {
+            unfold(node);
+        } else if (node->type == G_LAM && !spine.empty()) {
+            GraphNode *app = spine.back();
+            spine.pop_back();
+
+            app->lNode = instantiate(node, app->rNode);
+            app->rNode = NULL;
+            app->type = G_IND;
+            node = app;
+            stats.betaSteps++;
+        } else if (spine.empty()) {
+            return node;
+        } else {
+            return spine.front();
+        }
+    }
+}
+
+// Replaces a numeral with its church encoding. Numerals up to
+// UNFOLD_LIMIT are built whole, so applying one shares the copy of its
+// body between uses the way a parsed church numeral would; larger ones are
+// unfolded one layer at a time. Either way the graph is closed, so its
+// nodes take the numeral's stamp and copy shares it like any older node.
+void GraphReducer::unfold(GraphNode *num) {
+    vector<GraphNode *> vars;
+    size_t first = nodes.size();
+    Symbol f = names.f;
+    Symbol x = names.x;
+    uint64_t value;
+    GraphNode *church;
+
+    if (store.NumeralValue(num->name).ToUint64(value) &&
+        value <= UNFOLD_LIMIT) {
+        GraphNode *fVar = newNode(G_VAR, f, NULL, NULL);
+        GraphNode *xVar = newNode(G_VAR, x, NULL, NULL);
+        GraphNode *body = xVar;
+
+        for (uint64_t i = 0; i < value; i++)
+            body = newNode(G_APP, 0, fVar, body);
+
+        church = newNode(G_LAM, f, newNode(G_LAM, x, body, xVar), fVar);
+    } else {
+        church = toGraph(store.Unfold(num->name, f, x), vars);
+    }
+
+    for (size_t i = first; i < nodes.size(); i++) nodes[i].stamp = num->stamp;
+
+    num->lNode = church;
+    num->type = G_IND;
+}
+
+// Normalises node under abstractions and in the arguments of neutral
+// applications. Slots still to be normalised are kept on a stack; a node is
+// marked normal as soon as its children are queued so that shared nodes are
+// only normalised once.
+GraphNode *GraphReducer::normalize(GraphNode *node) {
+    vector<GraphNode **> slots;
+    slots.push_back(&node);
+
+    while (!slots.empty()) {
+        GraphNode **slot = slots.back();
+        slots.pop_back();
+
+        GraphNode *whnfNode = whnf(*slot);
+        *slot = whnfNode;
+        if (whnfNode->normal) continue;
+
+        whnfNode->normal = true;
+
+        if (whnfNode->type == G_LAM) {
+            slots.push_back(&whnfNode->lNode);
+            continue;
+        }
+
+        for (GraphNode *app = whnfNode; app->type == G_APP;
+             app = follow(app->lNode)) {
+            app->normal = true;
+            slots.push_back(&app->rNode);
+        }
+    }
+
+    return node;
+}
+
+GraphNode *GraphReducer::instantiate(GraphNode *lam, GraphNode *arg) {
+    epoch++;
+
+    GraphNode *var = follow(lam->rNode);
+    var->epoch = epoch;
+    var->copy = arg;
+    var->level = 0;
+
+    return copy(lam->lNode, var->stamp);
+}
+
+// Copies the part of a body that mentions a variable being replaced: the
+// instantiated variable itself (level 0) or the variable of an abstraction
+// that had to be copied on the way down (level = its nesting). Every copied
+// abstraction gets a fresh variable so copies can never capture each other.
+// A node's level is the outermost such variable it mentions, or UINT32_MAX
+// if it mentions none, in which case it is shared with the original.
+//
+// Reduction never adds free variables to a node, so a node made before the
+// instantiated variable (stamp below varStamp) cannot mention any of them
+// and is shared without being walked.
+GraphNode *GraphReducer::copy(GraphNode *body, uint64_t varStamp) {
+    vector<NodeVisit> visits;
+    vector<GraphNode *> results;
+    vector<uint32_t> levels;
+    visits.push_back({body, 1, false});
+
+    while (!visits.empty()) {
+        NodeVisit visit = visits.back();
+        visits.pop_back();
+        GraphNode *node = follow(visit.node);
+
+        if (!visit.expanded) {
+            if (visit.node->stamp < varStamp || node->stamp < varStamp) {
+                results.push_back(node);
+                levels.push_back(UINT32_MAX);
+                continue;
+            }
+
+            if (node->epoch == epoch) {
+                results.push_back(node->copy);
+                levels.push_back(node->level);
+                continue;
+            }
+
+            switch (node->type) {
+                case G_LAM:
+                    node->rNode->epoch = epoch;
+                    node->rNode->copy = newNode(G_VAR, node->name, NULL, NULL);
+                    node->rNode->level = visit.depth;
+                    visits.push_back({node, visit.depth, true});
+                    visits.push_back({node->lNode, visit.depth + 1, false});
+                    break;
+                case G_APP:
+                    visits.push_back({node, visit.depth, true});
+                    visits.push_back({node->rNode, visit.depth, false});
+                    visits.push_back({node->lNode, visit.depth, false});
+                    break;
+                default:
+                    node->epoch = epoch;
+                    node->copy = node;
+                    node->level = UINT32_MAX;
+                    results.push_back(node);
+                    levels.push_back(UINT32_MAX);
+                    break;
+            }
+
+            continue;
+        }
+
+        GraphNode *result = node;
+        GraphNode *rNode = results.back();
+        uint32_t level = levels.back();
+        results.pop_back();
+        levels.pop_back();
+
+        if (node->type == G_LAM) {
+            if (level < visit.depth) {
+                result = newNode(G_LAM, node->name, rNode,
+                                 node->rNode->copy);
+                stats.nodesCopied++;
+            } else {
+                level = UINT32_MAX;
+            }
+        } else {
+            GraphNode *lNode = results.back();
+            level = min(level, levels.back());
+            results.pop_back();
+            levels.pop_back();
+
+            if (level != UINT32_MAX) {
+                result = newNode(G_APP, 0, lNode, rNode);
+                stats.nodesCopied++;
+            }
+        }
+
+        node->epoch = epoch;
+        node->copy = result;
+        node->level = level;
+        results.push_back(result);
+        levels.push_back(level);
+    }
+
+    return results.back();
+}
+
+TermId GraphReducer::toTerm(GraphNode *node) {
+    vector<NodeVisit> visits;
+    vector<TermId> results;
+    visits.push_back({node, 0, false});
+
+    while (!visits.empty()) {
+        NodeVisit visit = visits.back();
+        visits.pop_back();
+        node = follow(visit.node);
+        TermId lTerm;
+        TermId rTerm;
+
+        if (visit.expanded) {
+            rTerm = results.back();
+            results.pop_back();
+
+            if (node->type == G_LAM) {
+                results.push_back(
+                    store.Make(ABSTRACTION, node->name, rTerm, NIL_TERM));
+            } else {
+                lTerm = results.back();
+                results.pop_back();
+                results.push_back(store.Make(APPLICATION, 0, lTerm, rTerm));
+            }
+
+            continue;
+        }
+
+        switch (node->type) {
+            case G_LAM:
+                node->rNode->depth = visit.depth;
+                visits.push_back({node, visit.depth, true});
+                visits.push_back({node->lNode, visit.depth + 1, false});
+                break;
+            case G_APP:
+                visits.push_back({node, visit.depth, true});
+                visits.push_back({node->rNode, visit.depth, false});
+                visits.push_back({node->lNode, visit.depth, false});
+                break;
+            case G_VAR:
+                results.push_back(store.Make(
+                    INDEX, visit.depth - node->depth - 1, NIL_TERM, NIL_TERM));
+                break;
+            case G_NUM:
+                results.push_back(node->name);
+                break;
+            default:
+                results.push_back(
+                    store.Make(PRIMARY, node->name, NIL_TERM, NIL_TERM));
+                break;
+        }
+    }
+
+    return results.back();
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#ifndef __GRAPH_H__
+#define __GRAPH_H__
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "definitions.hh"
+#include "stats.hh"
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+typedef enum {
+    G_LAM = 0,
+    G_APP,
+    G_VAR,
+    G_FREE,
+    G_DEF,
+    G_IND,
+    G_NUM
+} NodeType;
+
+// Largest numeral that is built as a whole church graph when applied.
+const uint64_t UNFOLD_LIMIT = 1 << 22;
+
+// A mutable graph node. LAM keeps its body in lNode and its bound VAR node
+// in rNode, APP applies lNode to rNode and IND forwards to lNode after an
+// application has been overwritten with its value. A DEF is a definition
+// that has not been looked up yet and a NUM is a compact numeral whose term
+// id is kept in name. stamp is the node's creation order.
+struct GraphNode {
+    NodeType type;
+    Symbol name;
+    GraphNode *lNode;
+    GraphNode *rNode;
+    GraphNode *copy;
+    uint64_t stamp;
+    uint32_t epoch;
+    uint32_t depth;
+    uint32_t level;
+    bool normal;
+};
+
+struct NodeVisit {
+    GraphNode *node;
+    uint32_t depth;
+    bool expanded;
+};
+
+// Call-by-need reduction on a shared term graph. An argument is never copied
+// into the body of the abstraction it is passed to; every occurrence points
+// at the same node, which is overwritten in place the first time it is
+// reduced, so each redex is reduced at most once.
+class GraphReducer {
+   public:
+    GraphReducer(TermStore &store, const Definitions &definitions,
+                 NumeralNames names);
+    TermId Normalize(TermId term);
+    const Stats &Statistics();
+
+   private:
+    TermStore &store;
+    const Definitions &definitions;
+    NumeralNames names;
+    deque<GraphNode> nodes;
+    map<Symbol, GraphNode *> sharedDefs;
+    map<Symbol, bool> recursiveDefs;
+    uint32_t epoch;
+    Stats stats;
+
+    GraphNode *newNode(NodeType type, Symbol name, GraphNode *lNode,
+                       GraphNode *rNode);
+    GraphNode *follow(GraphNode *node);
+    GraphNode *toGraph(TermId term, vector<GraphNode *> &vars);
+    GraphNode *definition(Symbol name);
+    bool isRecursive(Symbol name);
+    void findDefs(TermId term, map<Symbol, bool> &found);
+    GraphNode *whnf(GraphNode *node);
+    void unfold(GraphNode *num);
+    GraphNode *normalize(GraphNode *node);
+    GraphNode *instantiate(GraphNode *lam, GraphNode *arg);
+    GraphNode *copy(GraphNode *body, uint64_t varStamp);
+    TermId toTerm(GraphNode *node);
+};
+
+#endif
@@ -1,45 +1,155 @@
-#include "input.hh"
-
-#include <cstdio>
-#include <fstream>
-#include <iostream>
-#include <istream>
-#include <string>
-#include <vector>
-
-using namespace std;
-
-bool Input::OpenFile(string filename) {
-    file.open(filename);
-    return file.is_open();
-}
-
-void Input::GetChar(char &c) {
-    if (!buffer.empty()) {
-        c = buffer.back();
-        buffer.pop_back();
-    } else {
-        // cin.get(c);
-        file.get(c);
-    }
-}
-
-char Input::UngetChar(char c) {
-    if (c != EOF) buffer.push_back(c);
-    return c;
-}
-
-string Input::UngetString(string s) {
-    for (unsigned int i = 0; i < s.size(); i++)
-        buffer.push_back(s[s.size() - i - 1]);
-    return s;
-}
-
-bool Input::AtEnd() {
-    if (!buffer.empty())
-        return false;
-    else
-        // return cin.eof();
-        // return file.peek() == EOF;
-        return file.eof();
+#include "input.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+Input::Input() {
+    cursor = NULL;
+    end = NULL;
+}
+
+Input::~Input() {
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (sources[i].map != NULL)
+            munmap(sources[i].map, sources[i].mapLength);
+        if (sources[i].fd > 0) close(sources[i].fd);
+    }
+}
+
+// Pushes a file in front of what is left, or standard input for "-". A
+// regular file is mapped unless it is to be streamed; anything else, such as
+// a pipe, is always read as a stream, a chunk at a time.
+bool Input::OpenFile(string filename, bool stream) {
+    int fd = filename == "-" ? 0 : open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+
+    if (!stream && fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+        info.st_size > 0) {
+        void *map = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map != MAP_FAILED) {
+            madvise(map, info.st_size, MADV_SEQUENTIAL);
+            close(fd);
+
+            const char *text = (const char *)map;
+            Source source = {text, text, text + info.st_size, map,
+                             (size_t)info.st_size, vector<char>(), -1};
+            push(source);
+            return true;
+        }
+    }
+
+    vector<char> buffer;
+    pushBuffer(buffer, fd);
+    return true;
+}
+
+void Input::IncludeString(string s) {
+    vector<char> buffer(s.begin(), s.end());
+    pushBuffer(buffer);
+}
+
+// Reads on in a stream, or drops the views read through, and says whether
+// any text is left.
+bool Input::More() {
+    while (cursor == end && !active.empty()) {
+        if (refill(sources[active.back()])) continue;
+        if (active.size() == 1) break;
+
+        active.pop_back();
+        cursor = sources[active.back()].cursor;
+        end = sources[active.back()].end;
+    }
+
+    return cursor != end;
+}
+
+// The rest of the top view, which is empty only once all text is read.
+string_view Input::View() { return string_view(cursor, end - cursor); }
+
+void Input::Advance(size_t count) { cursor += count; }
+
+// Frees the chunks of streams that have been read through. Only tokens
+// scanned from the chunks being read stay valid.
+void Input::Release() { retired.clear(); }
+
+void Input::push(Source &source) {
+    if (!active.empty()) sources[active.back()].cursor = cursor;
+
+    sources.push_back(move(source));
+    active.push_back(sources.size() - 1);
+    cursor = sources.back().cursor;
+    end = sources.back().end;
+}
+
+void Input::pushBuffer(vector<char> &buffer, int fd) {
+    Source source = {NULL, NULL, NULL, NULL, 0, vector<char>(), fd};
+    source.buffer.swap(buffer);
+    source.begin = source.buffer.data();
+    source.cursor = source.begin;
+    source.end = source.begin + source.buffer.size();
+    push(source);
+}
+// Starts the next view of a stream with the bytes left over from the last
+// one, and reads until the view can end somewhere no token straddles: after
+// space or a one character token other than the two that start and end a
+// comment. At the end of the stream the view takes everything left.
+bool Input::refill(Source &source) {
+    if (source.map != NULL) return false;
+
+    size_t left = source.buffer.data() + source.buffer.size() - source.end;
+    if (source.fd < 0 && left == 0) return false;
+
+    vector<char> next(source.end, source.end + left);
+    size_t searched = 0;
+    size_t cut = 0;
+
+    while (true) {
+        for (size_t i = next.size(); i > searched && cut == 0; i--) {
+            char c = next[i - 1];
+            if (isspace((unsigned char)c) || strchr("=;!.()[]", c) != NULL)
+                cut = i;
+        }
+
+        if (cut > 0 || source.fd < 0) break;
+        searched = next.size();
+
+        next.resize(searched + STREAM_CHUNK);
+        ssize_t count = read(source.fd, next.data() + searched, STREAM_CHUNK);
+        next.resize(searched + (count > 0 ? count : 0));
+
+        if (count <= 0) {
+            if (source.fd > 0) close(source.fd);
+            source.fd = -1;
+        }
+    }
+
+    if (cut == 0) cut = next.size();
+
+    retired.push_back(vector<char>());
+    retired.back().swap(source.buffer);
+    source.buffer.swap(next);
+    source.begin = source.buffer.data();
+    source.cursor = source.begin;
+    source.end = source.begin + cut;
+
+    if (&source == &sources[active.back()]) {
+        cursor = source.cursor;
+        end = source.end;
+    }
+
+    return true;
 }
\ No newline at end of file
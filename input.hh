@@ -1,23 +1,61 @@
-#ifndef __INPUT_H__
-#define __INPUT_H__
-
-#include <fstream>
-#include <string>
-#include <vector>
-
-using namespace std;
-
-class Input {
-   public:
-    bool OpenFile(string filename);
-    void GetChar(char& c);
-    char UngetChar(char c);
-    string UngetString(string s);
-    bool AtEnd();
-
-   private:
-    ifstream file;
-    vector<char> buffer;
-};
-
-#endif
+#ifndef __INPUT_H__
+#define __INPUT_H__
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Fewest bytes a stream reads at once.
+const size_t STREAM_CHUNK = 1 << 16;
+
+// A stretch of text being read: a mapped file, a buffer holding text pushed
+// in front of the rest, or the part of a stream read so far. A stream keeps
+// fd open until it has been read to the end, and its buffer may hold more
+// than its view: the bytes after the last place a token cannot straddle,
+// which wait for the next chunk.
+struct Source {
+    const char *begin;
+    const char *cursor;
+    const char *end;
+    void *map;
+    size_t mapLength;
+    vector<char> buffer;
+    int fd;
+};
+
+// Reads the source as a stack of views, the innermost on top. Pushing a file
+// or a string in front of the rest costs no copy of what is already there,
+// and reading is a matter of looking at the view of the top and advancing
+// its cursor. The cursor and end of the top view are kept in the input
+// itself and only written back to its source when another is pushed.
+//
+// Tokens point into the views, so a view read through is only dropped from
+// the stack; its text lives as long as the input. The exception is a
+// stream, whose chunks once read through are kept only until Release.
+class Input {
+   public:
+    Input();
+    ~Input();
+    bool OpenFile(string filename, bool stream = false);
+    void IncludeString(string s);
+    bool More();
+    string_view View();
+    void Advance(size_t count);
+    void Release();
+
+   private:
+    vector<Source> sources;
+    vector<size_t> active;
+    vector<vector<char>> retired;
+    const char *cursor;
+    const char *end;
+
+    void push(Source &source);
+    void pushBuffer(vector<char> &buffer, int fd = -1);
+    bool refill(Source &source);
+};
+
+#endif
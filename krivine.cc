@@ -0,0 +1,409 @@
+#include "krivine.hh"
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Takes a cell the last collection freed, if there is one.
+template <typename Cell>
+static Cell *allocate(deque<Cell> &cells, vector<Cell *> &free,
+                      const Cell &cell) {
+    if (free.empty()) {
+        cells.push_back(cell);
+        return &cells.back();
+    }
+
+    Cell *reused = free.back();
+    free.pop_back();
+    *reused = cell;
+    return reused;
+}
+
+// Frees every cell left unmarked and clears the marks of the others.
+// Returns how many are kept.
+template <typename Cell>
+static size_t sweep(deque<Cell> &cells, vector<Cell *> &free) {
+    free.clear();
+
+    for (Cell &cell : cells) {
+        if (!cell.marked) free.push_back(&cell);
+        cell.marked = false;
+    }
+
+    return cells.size() - free.size();
+}
+
+LazyMachine::LazyMachine(TermStore &store, PassingMode passing)
+    : store(store), passing(passing) {
+    allocated = 0;
+    collectAt = HEAP_COLLECT_MIN;
+}
+
+const Stats &LazyMachine::Statistics() { return stats; }
+
+void LazyMachine::clear() {
+    thunks.clear();
+    envs.clear();
+    values.clear();
+    spines.clear();
+    freeThunks.clear();
+    freeEnvs.clear();
+    freeValues.clear();
+    freeSpines.clear();
+    shared.clear();
+    allocated = 0;
+    collectAt = HEAP_COLLECT_MIN;
+}
+
+Thunk *LazyMachine::newThunk(uint32_t code, Env *env, Value *value) {
+    allocated++;
+    return allocate(thunks, freeThunks, {code, false, env, value});
+}
+
+Env *LazyMachine::newEnv(Thunk *thunk, Env *next) {
+    allocated++;
+    return allocate(envs, freeEnvs, {thunk, next, false});
+}
+
+Value *LazyMachine::newClosure(uint32_t body, Symbol name, Env *env) {
+    allocated++;
+    return allocate(values, freeValues,
+                    {V_CLOSURE, body, env, false, false, name, NULL});
+}
+
+Value *LazyMachine::newNeutral(bool freeHead, uint32_t head, Spine *spine) {
+    allocated++;
+    return allocate(values, freeValues,
+                    {V_NEUTRAL, NIL_TERM, NULL, freeHead, false, head, spine});
+}
+
+Value *LazyMachine::newNumeral(TermId numeral) {
+    allocated++;
+    return allocate(values, freeValues,
+                    {V_NUMERAL, numeral, NULL, false, false, 0, NULL});
+}
+
+Spine *LazyMachine::newSpine(Thunk *arg, Spine *prev) {
+    allocated++;
+    return allocate(spines, freeSpines, {arg, prev, false});
+}
+
+Thunk *LazyMachine::lookup(Env *env, uint32_t index) {
+    for (uint32_t i = 0; i < index; i++) env = env->next;
+    return env->thunk;
+}
+
+// Marks from the roots with a work list per kind of cell, since
+// environments and spines may be longer than the call stack is deep.
+void LazyMachine::collect(Env *env, Value *value) {
+    vector<Thunk *> thunkWork;
+    vector<Env *> envWork;
+    vector<Value *> valueWork;
+    vector<Spine *> spineWork;
+
+    auto markThunk = [&](Thunk *thunk) {
+        if (thunk == NULL || thunk->marked) return;
+        thunk->marked = true;
+        thunkWork.push_back(thunk);
+    };
+    auto markEnv = [&](Env *env) {
+        if (env == NULL || env->marked) return;
+        env->marked = true;
+        envWork.push_back(env);
+    };
+    auto markValue = [&](Value *value) {
+        if (value == NULL || value->marked) return;
+        value->marked = true;
+        valueWork.push_back(value);
+    };
+    auto markSpine = [&](Spine *spine) {
+        if (spine == NULL || spine->marked) return;
+        spine->marked = true;
+        spineWork.push_back(spine);
+    };
+
+    markEnv(env);
+    markValue(value);
+
+    for (size_t i = 0; i < stack.size(); i++) {
+        markThunk(stack[i].thunk);
+        markValue(stack[i].function);
+    }
+
+    for (size_t i = 0; i < reads.size(); i++) {
+        markValue(reads[i].value);
+        markThunk(reads[i].thunk);
+    }
+
+    for (size_t i = 0; i < shared.size(); i++) markThunk(shared[i]);
+
+    while (!thunkWork.empty() || !envWork.empty() || !valueWork.empty() ||
+           !spineWork.empty()) {
+        if (!thunkWork.empty()) {
+            Thunk *thunk = thunkWork.back();
+            thunkWork.pop_back();
+            markEnv(thunk->env);
+            markValue(thunk->value);
+        } else if (!envWork.empty()) {
+            Env *env = envWork.back();
+            envWork.pop_back();
+            markThunk(env->thunk);
+            markEnv(env->next);
+        } else if (!valueWork.empty()) {
+            Value *value = valueWork.back();
+            valueWork.pop_back();
+            markEnv(value->env);
+            markSpine(value->spine);
+        } else {
+            Spine *spine = spineWork.back();
+            spineWork.pop_back();
+            markThunk(spine->arg);
+            markSpine(spine->prev);
+        }
+    }
+
+    size_t live = sweep(thunks, freeThunks) + sweep(envs, freeEnvs) +
+                  sweep(values, freeValues) + sweep(spines, freeSpines);
+    stats.collections++;
+    allocated = 0;
+    collectAt = max(live, HEAP_COLLECT_MIN);
+}
+
+// Unfolds the outermost layer of a numeral that is being applied. A
+// successor is !f.!x.f (pred f x) with pred bound in the environment, so
+// only the predecessor is made per layer.
+uint32_t LazyMachine::unfold(TermId numeral, Env *&env) {
+    env = NULL;
+    if (store.IsZero(numeral)) return zeroCode;
+
+    Value *pred = newNumeral(store.Predecessor(numeral));
+    env = newEnv(newThunk(NIL_TERM, NULL, pred), NULL);
+    return successorCode;
+}
+
+// Hands value to the continuation on top of the stack. Afterwards either
+// value is what the continuation made of it, or value is NULL and the
+// machine goes on with code in env. Passing by value evaluates an argument
+// before entering the function, which waits for it on the stack.
+void LazyMachine::resume(Value *&value, uint32_t &code, Env *&env) {
+    Continuation k = stack.back();
+    stack.pop_back();
+
+    if (k.type == K_UPDATE) {
+        k.thunk->value = value;
+    } else if (k.type == K_APPLY) {
+        env = newEnv(k.thunk, k.function->env);
+        code = k.function->term;
+        value = NULL;
+        stats.betaSteps++;
+    } else if (value->type == V_NUMERAL) {
+        stack.push_back(k);
+        code = unfold(value->term, env);
+        value = NULL;
+    } else if (value->type == V_CLOSURE && passing == PASS_BY_VALUE &&
+               k.thunk->value == NULL) {
+        stack.push_back({K_APPLY, k.thunk, value});
+        stack.push_back({K_UPDATE, k.thunk, NULL});
+        code = k.thunk->term;
+        env = k.thunk->env;
+        value = NULL;
+    } else if (value->type == V_CLOSURE) {
+        env = newEnv(k.thunk, value->env);
+        code = value->term;
+        value = NULL;
+        stats.betaSteps++;
+    } else {
+        value = newNeutral(value->freeHead, value->head,
+                           newSpine(k.thunk, value->spine));
+    }
+}
+
+Value *LazyMachine::force(Thunk *thunk) {
+    if (thunk->value == NULL && passing == PASS_BY_NAME)
+        return eval(thunk->term, thunk->env);
+    if (thunk->value == NULL) thunk->value = eval(thunk->term, thunk->env);
+    return thunk->value;
+}
+
+// Reads a value back as a term in normal form. A closure is applied to a
+// fresh variable, numbered by its De Bruijn level, and its body evaluated;
+// a neutral is rebuilt from its head and the read back of each argument.
+// A task stays on reads, where the collector sees it, until what it reads
+// has been evaluated.
+TermId LazyMachine::readBack(Value *value) {
+    vector<TermId> results;
+    reads.push_back({READ_VALUE, value, NULL, 0, 0});
+
+    while (!reads.empty()) {
+        if (reads.back().type == READ_THUNK)
+            reads.back().value = force(reads.back().thunk);
+
+        ReadTask task = reads.back();
+        reads.pop_back();
+        TermId lTerm;
+        TermId rTerm;
+
+        if (task.type == READ_ABS) {
+            lTerm = results.back();
+            results.pop_back();
+            results.push_back(
+                store.Make(ABSTRACTION, task.name, lTerm, NIL_TERM));
+            continue;
+        } else if (task.type == READ_APP) {
+            rTerm = results.back();
+            results.pop_back();
+            lTerm = results.back();
+            results.pop_back();
+            results.push_back(store.Make(APPLICATION, 0, lTerm, rTerm));
+            continue;
+        }
+
+        value = task.value;
+
+        if (value->type == V_CLOSURE) {
+            Value *var = newNeutral(false, task.level, NULL);
+            Env *env = newEnv(newThunk(NIL_TERM, NULL, var), value->env);
+
+            reads.push_back({READ_ABS, NULL, NULL, task.level, value->head});
+            reads.push_back({READ_VALUE, NULL, NULL, task.level + 1, 0});
+            reads.back().value = eval(value->term, env);
+            continue;
+        }
+
+        if (value->type == V_NUMERAL) {
+            results.push_back(value->term);
+            continue;
+        }
+
+        if (value->freeHead)
+            results.push_back(
+                store.Make(PRIMARY, value->head, NIL_TERM, NIL_TERM));
+        else
+            results.push_back(store.Make(INDEX, task.level - value->head - 1,
+                                         NIL_TERM, NIL_TERM));
+
+        for (Spine *spine = value->spine; spine != NULL; spine = spine->prev) {
+            reads.push_back({READ_APP, NULL, NULL, task.level, 0});
+            reads.push_back({READ_THUNK, NULL, spine->arg, task.level, 0});
+        }
+    }
+
+    return results.back();
+}
+
+KrivineMachine::KrivineMachine(TermStore &store,
+                               const Definitions &definitions,
+                               NumeralNames names, PassingMode passing)
+    : LazyMachine(store, passing), definitions(definitions) {
+    zeroCode = store.ChurchZero(names.f, names.x);
+    successorCode = store.ChurchSuccessor(
+        store.Make(INDEX, 2, NIL_TERM, NIL_TERM), names.f, names.x);
+}
+
+TermId KrivineMachine::Normalize(TermId term) {
+    TermId result = readBack(eval(term, NULL));
+
+    clear();
+    return result;
+}
+
+// Runs the machine from term in env until it reaches a weak head normal form
+// with no arguments left. Arguments waiting to be applied and thunks waiting
+// for their value are kept on stack. Passing by name never updates a thunk.
+// An argument that is a variable is passed as the thunk it is bound to
+// rather than a new one over the whole environment, which would keep all of
+// the environment alive for as long as the argument.
+Value *KrivineMachine::eval(uint32_t term, Env *env) {
+    size_t base = stack.size();
+    Value *value = NULL;
+
+    while (true) {
+        if (allocated >= collectAt) collect(env, value);
+
+        if (value == NULL) {
+            Term t = store[term];
+
+            switch (t.type) {
+                case APPLICATION: {
+                    Term arg = store[t.rTerm];
+                    Thunk *thunk = arg.type == INDEX
+                                       ? lookup(env, arg.var)
+                                       : newThunk(t.rTerm, env, NULL);
+                    stack.push_back({K_ARG, thunk, NULL});
+                    term = t.lTerm;
+                    continue;
+                }
+                case ABSTRACTION:
+                    if (passing != PASS_BY_VALUE && stack.size() > base &&
+                        stack.back().type == K_ARG) {
+                        env = newEnv(stack.back().thunk, env);
+                        stack.pop_back();
+                        term = t.lTerm;
+                        stats.betaSteps++;
+                        continue;
+                    }
+
+                    value = newClosure(t.lTerm, t.var, env);
+                    break;
+                case INDEX: {
+                    Thunk *thunk = lookup(env, t.var);
+                    if (thunk->value != NULL) {
+                        value = thunk->value;
+                    } else {
+                        if (passing != PASS_BY_NAME)
+                            stack.push_back({K_UPDATE, thunk, NULL});
+                        term = thunk->term;
+                        env = thunk->env;
+                        continue;
+                    }
+                    break;
+                }
+                case PRIMARY: {
+                    TermId definition = definitions.Find(t.var);
+
+                    if (definition == NIL_TERM) {
+                        value = newNeutral(true, t.var, NULL);
+                        break;
+                    }
+
+                    if (passing == PASS_BY_NAME) {
+                        term = definition;
+                        env = NULL;
+                        stats.unfoldings++;
+                        continue;
+                    }
+
+                    if (t.var >= shared.size()) shared.resize(t.var + 1, NULL);
+                    if (shared[t.var] == NULL)
+                        shared[t.var] = newThunk(definition, NULL, NULL);
+
+                    Thunk *thunk = shared[t.var];
+                    if (thunk->value != NULL) {
+                        value = thunk->value;
+                    } else {
+                        stack.push_back({K_UPDATE, thunk, NULL});
+                        term = thunk->term;
+                        env = NULL;
+                        stats.unfoldings++;
+                        continue;
+                    }
+                    break;
+                }
+                case NUMERAL:
+                    if (stack.size() > base && stack.back().type == K_ARG) {
+                        term = unfold(term, env);
+                        continue;
+                    }
+
+                    value = newNumeral(term);
+                    break;
+            }
+        }
+
+        if (stack.size() == base) return value;
+        resume(value, term, env);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,161 @@
+#ifndef __KRIVINE_H__
+#define __KRIVINE_H__
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "definitions.hh"
+#include "stats.hh"
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+struct Thunk;
+struct Value;
+
+// Most cells the machine allocates between two collections of its heap.
+const size_t HEAP_COLLECT_MIN = 1 << 20;
+
+// Environments and neutral spines are immutable linked lists, so extending
+// one never copies it. Every cell of the heap has a mark for the collector.
+struct Env {
+    Thunk *thunk;
+    Env *next;
+    bool marked;
+};
+
+struct Spine {
+    Thunk *arg;
+    Spine *prev;
+    bool marked;
+};
+
+// A suspended term together with the environment it closes over. value is
+// filled in the first time the thunk is forced and shared from then on. term
+// is whatever code the machine runs: a term id, or an address in bytecode.
+struct Thunk {
+    TermId term;
+    bool marked;
+    Env *env;
+    Value *value;
+};
+
+typedef enum { V_CLOSURE = 0, V_NEUTRAL, V_NUMERAL } ValueType;
+
+// A weak head normal form: either an abstraction closed over env, or a
+// variable applied to the arguments in spine (last argument first). A
+// closure keeps the code of its body in term and the name it binds in head.
+// The head of a neutral is a free name or, under read back, the De Bruijn
+// level of a fresh variable. A numeral is kept compact as its term until it
+// is applied.
+struct Value {
+    ValueType type;
+    TermId term;
+    Env *env;
+    bool freeHead;
+    bool marked;
+    uint32_t head;
+    Spine *spine;
+};
+
+typedef enum { K_ARG = 0, K_UPDATE, K_APPLY } ContinuationType;
+
+// K_APPLY waits for its argument to be evaluated before entering function.
+struct Continuation {
+    ContinuationType type;
+    Thunk *thunk;
+    Value *function;
+};
+
+// How arguments are passed: as shared thunks evaluated at most once, as
+// thunks evaluated again at every use, or evaluated before the call.
+typedef enum { PASS_BY_NEED = 0, PASS_BY_NAME, PASS_BY_VALUE } PassingMode;
+
+typedef enum { READ_VALUE = 0, READ_THUNK, READ_ABS, READ_APP } ReadTaskType;
+
+// READ_THUNK reads back an argument of a neutral, which is only forced once
+// the task is reached. READ_ABS only keeps the name of the abstraction it
+// rebuilds, so that the closure read back is not kept alive by the task.
+struct ReadTask {
+    ReadTaskType type;
+    Value *value;
+    Thunk *thunk;
+    uint32_t level;
+    Symbol name;
+};
+
+// What a lazy Krivine machine does besides running its code: it keeps the
+// heap and the stack, hands values to the continuations on the stack,
+// unfolds numerals and reads values back. A machine supplies eval, which
+// runs its code until it has a value and then calls resume, and the code of
+// the church forms of zero and successor with pred bound in the environment.
+//
+// The heap is collected by marking what the stack, the read back, the shared
+// thunks of definitions and the registers of eval reach, and reusing every
+// other cell, once the machine has allocated as many cells as the last
+// collection kept. eval offers to collect at the top of its loop, where its
+// registers hold all it refers to. shared keeps the thunk of each definition
+// a machine has entered, at whatever index the machine gives definitions.
+class LazyMachine {
+   public:
+    const Stats &Statistics();
+
+   protected:
+    TermStore &store;
+    PassingMode passing;
+    deque<Thunk> thunks;
+    deque<Env> envs;
+    deque<Value> values;
+    deque<Spine> spines;
+    vector<Thunk *> freeThunks;
+    vector<Env *> freeEnvs;
+    vector<Value *> freeValues;
+    vector<Spine *> freeSpines;
+    size_t allocated;
+    size_t collectAt;
+    vector<Continuation> stack;
+    vector<ReadTask> reads;
+    vector<Thunk *> shared;
+    uint32_t zeroCode;
+    uint32_t successorCode;
+    Stats stats;
+
+    LazyMachine(TermStore &store, PassingMode passing);
+    virtual ~LazyMachine() {}
+    virtual Value *eval(uint32_t code, Env *env) = 0;
+    void clear();
+    Thunk *newThunk(uint32_t code, Env *env, Value *value);
+    Env *newEnv(Thunk *thunk, Env *next);
+    Value *newClosure(uint32_t body, Symbol name, Env *env);
+    Value *newNeutral(bool freeHead, uint32_t head, Spine *spine);
+    Value *newNumeral(TermId numeral);
+    Spine *newSpine(Thunk *arg, Spine *prev);
+    Thunk *lookup(Env *env, uint32_t index);
+    void collect(Env *env, Value *value);
+    uint32_t unfold(TermId numeral, Env *&env);
+    void resume(Value *&value, uint32_t &code, Env *&env);
+    Value *force(Thunk *thunk);
+    TermId readBack(Value *value);
+};
+
+// A lazy Krivine machine. Terms are evaluated to weak head normal form in an
+// environment of shared thunks, so bodies are never copied and arguments are
+// evaluated at most once, unless the machine passes them by name or by
+// value instead. The normal form is read back by applying each closure to a
+// fresh variable and evaluating its body in turn.
+class KrivineMachine : public LazyMachine {
+   public:
+    KrivineMachine(TermStore &store, const Definitions &definitions,
+                   NumeralNames names, PassingMode passing = PASS_BY_NEED);
+    TermId Normalize(TermId term);
+
+   private:
+    const Definitions &definitions;
+
+    Value *eval(uint32_t term, Env *env);
+};
+
+#endif
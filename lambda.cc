@@ -1,17 +1,183 @@
-#include <iostream>
-
-#include "parser.hh"
-
-using namespace std;
-
-int main(int argc, char** argv) {
-    if (argc < 2) {
-        cout << "Error: Include a local file name to interpret" << endl;
-        exit(1);
-    }
-
-    Parser parser;
-    parser.OpenFile(argv[1]);
-    parser.ParseInput();
-    parser.ReduceAndPrint();
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "output.hh"
+#include "parser.hh"
+
+using namespace std;
+
+// Reads an argument that must be a whole number of at least 1.
+bool readPositive(const char *text, long &value) {
+    char *end;
+    value = strtol(text, &end, 10);
+    return end != text && *end == '\0' && value > 0;
+}
+
+void usage() {
+    cout << "Usage: lambda [options] file.lmb (- reads standard input)\n"
+            "Options:\n"
+            "  --engine=subst|graph|krivine|vm|optimal\n"
+            "  --strategy=normal|cbv|cbn|cbneed\n"
+            "  --hash-cons  --disassemble  --steps  --stats[=json]  --stream\n"
+            "  --normalize-defs[=STEPS]  --detect-divergence[=TERMS]\n"
+            "  -j JOBS  --parallel=THREADS  --parallel-cutoff=NODES\n";
+}
+
+int main(int argc, char** argv) {
+    // Results are flushed when the run is over or a stream asks for it, not
+    // at every line, even on a terminal.
+    setvbuf(stdout, NULL, _IOFBF, OUTPUT_BUFFER);
+
+    string filename = "";
+    bool hashCons = false;
+    EngineType engine = ENGINE_SUBST;
+    bool engineChosen = false;
+    Strategy strategy = STRATEGY_DEFAULT;
+    bool showSteps = false;
+    StatsFormat statsFormat = STATS_NONE;
+    bool showBytecode = false;
+    int jobs = 1;
+    int threads = 1;
+    size_t cutoff = 1024;
+    uint64_t defStepLimit = 0;
+    size_t growthLimit = 0;
+    bool stream = false;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg.compare("--hash-cons") == 0) {
+            hashCons = true;
+        } else if (arg.compare("--engine=subst") == 0) {
+            engine = ENGINE_SUBST;
+            engineChosen = true;
+        } else if (arg.compare("--engine=graph") == 0) {
+            engine = ENGINE_GRAPH;
+            engineChosen = true;
+        } else if (arg.compare("--engine=krivine") == 0) {
+            engine = ENGINE_KRIVINE;
+            engineChosen = true;
+        } else if (arg.compare("--engine=vm") == 0) {
+            engine = ENGINE_VM;
+            engineChosen = true;
+        } else if (arg.compare("--engine=optimal") == 0) {
+            engine = ENGINE_OPTIMAL;
+            engineChosen = true;
+        } else if (arg.compare(0, 11, "--strategy=") == 0) {
+            if (!FindStrategy(arg.substr(11), strategy)) {
+                cout << "Error: Unknown strategy " << arg.substr(11) << endl;
+                exit(1);
+            }
+        } else if (arg.compare("--detect-divergence") == 0) {
+            growthLimit = (size_t)1 << 24;
+        } else if (arg.compare(0, 20, "--detect-divergence=") == 0) {
+            long value;
+            if (!readPositive(arg.c_str() + 20, value)) {
+                cout << "Error: --detect-divergence expects a positive number "
+                        "of terms"
+                     << endl;
+                usage();
+                exit(1);
+            }
+
+            growthLimit = value;
+        } else if (arg.compare("--stream") == 0) {
+            stream = true;
+        } else if (arg.compare("--disassemble") == 0) {
+            showBytecode = true;
+        } else if (arg.compare("--steps") == 0) {
+            showSteps = true;
+        } else if (arg.compare("--stats") == 0) {
+            statsFormat = STATS_TEXT;
+        } else if (arg.compare("--stats=json") == 0) {
+            statsFormat = STATS_JSON;
+        } else if (arg.compare("--normalize-defs") == 0) {
+            defStepLimit = 10000;
+        } else if (arg.compare(0, 17, "--normalize-defs=") == 0) {
+            long value;
+            if (!readPositive(arg.c_str() + 17, value)) {
+                cout << "Error: --normalize-defs expects a positive step limit"
+                     << endl;
+                usage();
+                exit(1);
+            }
+
+            defStepLimit = value;
+        } else if (arg.compare(0, 2, "-j") == 0) {
+            const char *count = argv[i] + 2;
+            if (*count == '\0') count = i + 1 < argc ? argv[++i] : "";
+
+            long value;
+            if (!readPositive(count, value)) {
+                cout << "Error: -j expects a positive number of jobs" << endl;
+                exit(1);
+            }
+
+            jobs = value;
+        } else if (arg.compare(0, 11, "--parallel=") == 0) {
+            long value;
+            if (!readPositive(arg.c_str() + 11, value)) {
+                cout << "Error: --parallel expects a positive number of threads"
+                     << endl;
+                usage();
+                exit(1);
+            }
+
+            threads = value;
+        } else if (arg.compare(0, 18, "--parallel-cutoff=") == 0) {
+            long value;
+            if (!readPositive(arg.c_str() + 18, value)) {
+                cout << "Error: --parallel-cutoff expects a positive number "
+                        "of nodes"
+                     << endl;
+                usage();
+                exit(1);
+            }
+
+            cutoff = value;
+        } else if (arg[0] == '-' && arg.size() > 1) {
+            cout << "Error: Unknown option " << arg << endl;
+            exit(1);
+        } else {
+            filename = arg;
+        }
+    }
+
+    if (filename.empty()) {
+        cout << "Error: Include a local file name to interpret" << endl;
+        exit(1);
+    }
+
+    // The divergence detector only watches the substitution engine reducing
+    // on one thread.
+    bool watched = (!engineChosen || engine == ENGINE_SUBST) &&
+                   threads == 1 &&
+                   (strategy == STRATEGY_DEFAULT || strategy == STRATEGY_NORMAL);
+
+    if (growthLimit > 0 && !watched) {
+        cout << "Error: --detect-divergence only works with the subst engine "
+                "and the normal strategy, without --parallel"
+             << endl;
+        usage();
+        exit(1);
+    }
+
+    Parser parser;
+    if (hashCons) parser.EnableHashConsing();
+    if (engineChosen || threads > 1) parser.SetEngine(engine);
+    parser.SetStrategy(strategy);
+    if (showSteps) parser.ShowSteps();
+    parser.ShowStats(statsFormat);
+    if (showBytecode) parser.ShowBytecode();
+    parser.SetJobs(jobs);
+    parser.SetParallel(threads, cutoff);
+    if (defStepLimit > 0) parser.NormalizeDefinitions(defStepLimit);
+    if (growthLimit > 0) parser.DetectDivergence(growthLimit);
+    if (stream) parser.StreamStatements();
+    parser.OpenFile(filename);
+    parser.ParseInput();
+    parser.ReduceAndPrint();
 }
\ No newline at end of file
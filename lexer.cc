@@ -1,233 +1,201 @@
-#include "lexer.hh"
-
-#include <cctype>
-#include <iostream>
-#include <istream>
-#include <map>
-#include <string>
-#include <vector>
-
-#include "input.hh"
-
-using namespace std;
-
-string reserved[] = {"END_OF_FILE", "ERROR",           "LET",    "PRINT",
-                     "EQUAL",       "SEMICOLON",       "LAMBDA", "DOT",
-                     "LPAREN",      "RPAREN",          "ID",     "NUM",
-                     "IMPORT",      "HEADER_EXTENSION"};
-
-map<string, int> keywords = {{"let", 2},       {"print", 3},   {"printnum", 3},
-                             {"printbool", 3}, {"import", 12}, {"lmh", 13}};
-
-map<string, int> specialSequences = {{"/*", 13}, {"*/", 14}};
-
-void Token::Print() {
-    cout << "{" << lexeme << " , " << reserved[(int)tokenType] << " , "
-         << lineNum << "}\n";
-}
-
-Lexer::Lexer() {
-    lineNum = 1;
-    tmp.lexeme = "";
-    tmp.lineNum = 1;
-    tmp.tokenType = ERROR;
-}
-
-bool Lexer::OpenFile(string filename) { return input.OpenFile(filename); }
-
-Token Lexer::GetToken() {
-    char c;
-
-    if (!tokens.empty()) {
-        tmp = tokens.back();
-        tokens.pop_back();
-        return tmp;
-    }
-
-    skipSpace();
-    tmp.lexeme = "";
-    tmp.lineNum = lineNum;
-    tmp.tokenType = END_OF_FILE;
-
-    if (!input.AtEnd())
-        input.GetChar(c);
-    else
-        return tmp;
-
-    switch (c) {
-        case '=':
-            tmp.tokenType = EQUAL;
-            return tmp;
-        case ';':
-            tmp.tokenType = SEMICOLON;
-            return tmp;
-        case '!':
-            tmp.tokenType = LAMBDA;
-            return tmp;
-        case '.':
-            tmp.tokenType = DOT;
-            return tmp;
-        case '(':
-            tmp.tokenType = LPAREN;
-            return tmp;
-        case ')':
-            tmp.tokenType = RPAREN;
-            return tmp;
-        case '/':
-            if (input.AtEnd()) {
-                tmp.tokenType = ERROR;
-                return tmp;
-            }
-
-            input.GetChar(c);
-
-            if (c != '*' || input.AtEnd()) {
-                tmp.tokenType = ERROR;
-                return tmp;
-            }
-
-            while (true) {
-                input.GetChar(c);
-
-                if (input.AtEnd()) {
-                    tmp.tokenType = ERROR;
-                    return tmp;
-                }
-
-                if (c != '*') continue;
-                while (c == '*' && !input.AtEnd()) input.GetChar(c);
-                if (c == '/') break;
-
-                if (input.AtEnd()) {
-                    tmp.tokenType = ERROR;
-                    return tmp;
-                }
-            }
-
-            return GetToken();
-        default:
-            if (isdigit(c)) {
-                input.UngetChar(c);
-                return scanNumber();
-            } else if (isalpha(c)) {
-                input.UngetChar(c);
-                return scanIdOrKeyword();
-            } else if (input.AtEnd()) {
-                tmp.tokenType = END_OF_FILE;
-                return tmp;
-            } else {
-                tmp.tokenType = ERROR;
-                return tmp;
-            }
-    }
-}
-
-TokenType Lexer::UngetToken(Token tok) {
-    tokens.push_back(tok);
-    return tok.tokenType;
-}
-
-Token Lexer::Peek() {
-    Token t = GetToken();
-    UngetToken(t);
-    return t;
-}
-
-void Lexer::UnshiftString(string str) { input.UngetString(str); }
-
-bool Lexer::skipSpace() {
-    char c;
-    bool spaceEncountered = false;
-
-    input.GetChar(c);
-    lineNum += (c == '\n');
-
-    while (!input.AtEnd() && isspace(c)) {
-        spaceEncountered = true;
-        input.GetChar(c);
-        lineNum += (c == '\n');
-    }
-
-    if (!input.AtEnd()) {
-        input.UngetChar(c);
-    }
-
-    return spaceEncountered;
-}
-
-bool Lexer::isKeyword(string s) { return keywords.find(s) != keywords.end(); }
-
-TokenType Lexer::findKeywordTokenType(string s) {
-    return (TokenType)keywords[s];
-}
-
-Token Lexer::scanNumber() {
-    char c;
-
-    input.GetChar(c);
-    if (isdigit(c)) {
-        if (c == '0') {
-            tmp.lexeme = "0";
-        } else {
-            tmp.lexeme = "";
-
-            while (!input.AtEnd() && isdigit(c)) {
-                tmp.lexeme += c;
-                input.GetChar(c);
-            }
-
-            if (!input.AtEnd()) {
-                input.UngetChar(c);
-            }
-        }
-
-        tmp.tokenType = NUM;
-        tmp.lineNum = lineNum;
-
-        return tmp;
-    } else {
-        if (!input.AtEnd()) {
-            input.UngetChar(c);
-        }
-
-        tmp.lexeme = "";
-        tmp.tokenType = ERROR;
-        tmp.lineNum = lineNum;
-
-        return tmp;
-    }
-}
-
-Token Lexer::scanIdOrKeyword() {
-    char c;
-    input.GetChar(c);
-
-    if (isalpha(c)) {
-        tmp.lexeme = "";
-
-        while (!input.AtEnd() && isalnum(c)) {
-            tmp.lexeme += c;
-            input.GetChar(c);
-        }
-
-        if (!input.AtEnd()) {
-            input.UngetChar(c);
-        }
-
-        tmp.lineNum = lineNum;
-
-        if (isKeyword(tmp.lexeme))
-            tmp.tokenType = findKeywordTokenType(tmp.lexeme);
-        else
-            tmp.tokenType = ID;
-    } else {
-        if (!input.AtEnd()) {
-            input.UngetChar(c);
-        }
-
-        tmp.lexeme = "";
-        tmp.tokenType = ERROR;
-    }
-
-    return tmp;
+#include "lexer.hh"
+
+#include <cctype>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+
+#include "input.hh"
+
+using namespace std;
+
+string reserved[] = {"END_OF_FILE", "ERROR",           "LET",    "PRINT",
+                     "EQUAL",       "SEMICOLON",       "LAMBDA", "DOT",
+                     "LPAREN",      "RPAREN",          "ID",     "NUM",
+                     "IMPORT",      "HEADER_EXTENSION", "LBRACKET",
+                     "RBRACKET"};
+
+void Token::Print() {
+    cout << "{" << lexeme << " , " << reserved[(int)tokenType] << " , "
+         << lineNum << "}\n";
+}
+
+Lexer::Lexer() {
+    first = 0;
+    count = 0;
+    lineNum = 1;
+}
+
+bool Lexer::OpenFile(string filename, bool stream) {
+    return input.OpenFile(filename, stream);
+}
+
+Token Lexer::GetToken() {
+    if (count == 0) return scan();
+
+    Token token = lookahead[first];
+    first = (first + 1) % LOOKAHEAD;
+    count--;
+    return token;
+}
+
+TokenType Lexer::UngetToken(Token tok) {
+    if (count == LOOKAHEAD) {
+        cout << "RUNTIME ERROR: Too many tokens given back to the lexer\n";
+        exit(1);
+    }
+
+    first = (first + LOOKAHEAD - 1) % LOOKAHEAD;
+    lookahead[first] = tok;
+    count++;
+    return tok.tokenType;
+}
+
+Token Lexer::Peek() {
+    if (count == 0) {
+        lookahead[first] = scan();
+        count = 1;
+    }
+
+    return lookahead[first];
+}
+
+void Lexer::UnshiftString(string str) { input.IncludeString(str); }
+
+// Called between statements of a stream, when the parser holds no tokens
+// but the one it has peeked at.
+void Lexer::Release() { input.Release(); }
+
+// Reads the next token straight off the view of the input, so its lexeme
+// is a slice of the source. Comments are skipped like space.
+Token Lexer::scan() {
+    Token token;
+
+    while (true) {
+        skipSpace();
+        token.lexeme = string_view();
+        token.lineNum = lineNum;
+        token.tokenType = END_OF_FILE;
+
+        if (!input.More()) return token;
+
+        string_view text = input.View();
+        const char *begin = text.data();
+        const char *end = begin + text.size();
+        const char *p = begin + 1;
+
+        switch (*begin) {
+            case '=':
+                token.tokenType = EQUAL;
+                break;
+            case ';':
+                token.tokenType = SEMICOLON;
+                break;
+            case '!':
+                token.tokenType = LAMBDA;
+                break;
+            case '.':
+                token.tokenType = DOT;
+                break;
+            case '(':
+                token.tokenType = LPAREN;
+                break;
+            case ')':
+                token.tokenType = RPAREN;
+                break;
+            case '[':
+                token.tokenType = LBRACKET;
+                break;
+            case ']':
+                token.tokenType = RBRACKET;
+                break;
+            case '/':
+                token.tokenType = ERROR;
+                if (p == end || *p != '*') break;
+
+                input.Advance(2);
+                if (!skipComment()) return token;
+                continue;
+            default:
+                if (*begin == '0') {
+                    token.tokenType = NUM;
+                } else if (isdigit((unsigned char)*begin)) {
+                    while (p != end && isdigit((unsigned char)*p)) p++;
+                    token.tokenType = NUM;
+                } else if (isalpha((unsigned char)*begin)) {
+                    while (p != end && isalnum((unsigned char)*p)) p++;
+                    token.tokenType =
+                        findKeywordTokenType(string_view(begin, p - begin));
+                } else {
+                    token.tokenType = ERROR;
+                }
+        }
+
+        token.lexeme = string_view(begin, p - begin);
+        input.Advance(p - begin);
+        return token;
+    }
+}
+
+void Lexer::skipSpace() {
+    while (input.More()) {
+        string_view text = input.View();
+        const char *begin = text.data();
+        const char *end = begin + text.size();
+        const char *p = begin;
+
+        for (; p != end && isspace((unsigned char)*p); p++) lineNum += (*p == '\n');
+
+        input.Advance(p - begin);
+        if (p != end) return;
+    }
+}
+
+// Skips the rest of a comment, which may run over several views. False if
+// the input ends first.
+bool Lexer::skipComment() {
+    while (input.More()) {
+        string_view text = input.View();
+        const char *begin = text.data();
+        const char *end = begin + text.size();
+
+        for (const char *p = begin; p != end; p++) {
+            if (p[0] == '*' && p + 1 != end && p[1] == '/') {
+                input.Advance(p + 2 - begin);
+                return true;
+            }
+
+            lineNum += (*p == '\n');
+        }
+
+        input.Advance(end - begin);
+    }
+
+    return false;
+}
+
+// Keywords are told apart by length first, so an identifier is compared
+// with at most two of them.
+TokenType Lexer::findKeywordTokenType(string_view word) {
+    switch (word.size()) {
+        case 3:
+            if (word == "let") return LET;
+            if (word == "lmh") return HEADER_EXTENSION;
+            break;
+        case 5:
+            if (word == "print") return PRINT;
+            break;
+        case 6:
+            if (word == "import") return IMPORT;
+            break;
+        case 8:
+            if (word == "printnum") return PRINT;
+            break;
+        case 9:
+            if (word == "printbool") return PRINT;
+            break;
+    }
+
+    return ID;
 }
\ No newline at end of file
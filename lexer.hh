@@ -1,57 +1,66 @@
-#ifndef __LEXER_H__
-#define __LEXER_H__
-
-#include <string>
-#include <vector>
-
-#include "input.hh"
-
-typedef enum {
-    END_OF_FILE = 0,
-    ERROR,
-    LET,
-    PRINT,
-    EQUAL,
-    SEMICOLON,
-    LAMBDA,
-    DOT,
-    LPAREN,
-    RPAREN,
-    ID,
-    NUM,
-    IMPORT,
-    HEADER_EXTENSION,
-} TokenType;
-
-class Token {
-   public:
-    void Print();
-
-    std::string lexeme;
-    TokenType tokenType;
-    int lineNum;
-};
-
-class Lexer {
-   public:
-    bool OpenFile(string filename);
-    Token GetToken();
-    TokenType UngetToken(Token);
-    Token Peek();
-    void UnshiftString(string str);
-    Lexer();
-
-   private:
-    std::vector<Token> tokens;
-    int lineNum;
-    Token tmp;
-    Input input;
-
-    bool skipSpace();
-    bool isKeyword(std::string);
-    TokenType findKeywordTokenType(std::string);
-    Token scanNumber();
-    Token scanIdOrKeyword();
-};
-
-#endif
+#ifndef __LEXER_H__
+#define __LEXER_H__
+
+#include <string>
+#include <string_view>
+
+#include "input.hh"
+
+typedef enum {
+    END_OF_FILE = 0,
+    ERROR,
+    LET,
+    PRINT,
+    EQUAL,
+    SEMICOLON,
+    LAMBDA,
+    DOT,
+    LPAREN,
+    RPAREN,
+    ID,
+    NUM,
+    IMPORT,
+    HEADER_EXTENSION,
+    LBRACKET,
+    RBRACKET,
+} TokenType;
+
+// A token's lexeme is a view of the source text, valid for as long as the
+// lexer that made it.
+class Token {
+   public:
+    void Print();
+
+    std::string_view lexeme;
+    TokenType tokenType;
+    int lineNum;
+};
+
+// Tokens given back with UngetToken wait in a small ring in front of the
+// input; the parser never looks more than two tokens ahead.
+class Lexer {
+   public:
+    bool OpenFile(string filename, bool stream = false);
+    Token GetToken();
+    TokenType UngetToken(Token);
+    Token Peek();
+    void UnshiftString(string str);
+    void Release();
+    Lexer();
+
+   private:
+    static const int LOOKAHEAD = 4;
+
+    Token lookahead[LOOKAHEAD];
+    int first;
+    int count;
+    int lineNum;
+    Input input;
+
+    Token scan();
+    void skipSpace();
+    bool skipComment();
+    TokenType findKeywordTokenType(std::string_view word);
+};
+
+#endif
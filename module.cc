@@ -0,0 +1,314 @@
+#include "module.hh"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "natural.hh"
+
+using namespace std;
+
+const char MODULE_MAGIC[4] = {'L', 'M', 'H', 'C'};
+const uint32_t MODULE_VERSION = 1;
+
+// Numbers are written seven bits to a byte, least significant first, with
+// the top bit set on every byte but the last.
+static void put(string &data, uint64_t value) {
+    while (value >= 0x80) {
+        data += (char)(value | 0x80);
+        value >>= 7;
+    }
+    data += (char)value;
+}
+
+static void putString(string &data, const string &s) {
+    put(data, s.size());
+    data += s;
+}
+
+static bool get(const char *&p, const char *end, uint64_t &value) {
+    value = 0;
+
+    for (int shift = 0; p != end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (byte < 0x80) return true;
+    }
+
+    return false;
+}
+
+static bool getString(const char *&p, const char *end, string_view &s) {
+    uint64_t size;
+    if (!get(p, end, size) || (uint64_t)(end - p) < size) return false;
+
+    s = string_view(p, size);
+    p += size;
+    return true;
+}
+
+ModuleCache::ModuleCache(TermStore &store, SymbolTable &symbols)
+    : store(store), symbols(symbols) {}
+
+// Fills entries from the cache of filename if there is one that still
+// stands for it. Terms are made in the store as they are read, and dropped
+// again with the names and numerals they interned if the cache turns out to
+// be bad part of the way through.
+bool ModuleCache::Load(const string &filename, vector<ModuleEntry> &entries) {
+    ModuleSource source;
+    if (!statSource(filename, source)) return false;
+
+    ifstream file(filename + "c", ios::binary | ios::ate);
+    if (!file.is_open()) return false;
+
+    string data(file.tellg(), '\0');
+    file.seekg(0);
+    if (!file.read(&data[0], data.size())) return false;
+
+    size_t termMark = store.Mark();
+    size_t numeralMark = store.NumeralMark();
+    size_t symbolMark = symbols.Size();
+    if (readCache(filename, data, source, entries)) return true;
+
+    entries.clear();
+    store.Release(termMark);
+    store.ReleaseNumerals(numeralMark);
+    symbols.Truncate(symbolMark);
+    return false;
+}
+
+// Writes the cache of filename for entries, whose terms must be in the
+// store. Terms are numbered from 1 in the order they were made, and refer to
+// their children by how far back they are. The file is written under a
+// temporary name and renamed into place, so a run reading it at the same
+// time sees either the old or the new one. Failing to write it is not an
+// error; the module is parsed again next time.
+void ModuleCache::Save(const string &filename,
+                       const vector<ModuleEntry> &entries) {
+    ModuleSource source;
+    if (!statSource(filename, source) || !hashSource(filename, source.hash))
+        return;
+
+    TermId top = NIL_TERM;
+    for (size_t i = 0; i < entries.size(); i++)
+        if (entries[i].type == ENTRY_LET && entries[i].term > top)
+            top = entries[i].term;
+
+    vector<uint32_t> local(top + 1, 0);
+    for (size_t i = 0; i < entries.size(); i++)
+        if (entries[i].type == ENTRY_LET) local[entries[i].term] = 1;
+
+    for (TermId id = top; id > NIL_TERM; id--) {
+        Term &term = store[id];
+        if (local[id] == 0) continue;
+        if (term.type == ABSTRACTION || term.type == APPLICATION)
+            local[term.lTerm] = 1;
+        if (term.type == APPLICATION) local[term.rTerm] = 1;
+    }
+
+    vector<uint32_t> nameIndex;
+    string names;
+    string numerals;
+    string terms;
+    uint32_t nameCount = 0;
+    uint32_t numeralCount = 0;
+    uint32_t count = 0;
+
+    for (TermId id = 1; id <= top; id++) {
+        if (local[id] == 0) continue;
+
+        Term &term = store[id];
+        uint64_t var = term.var;
+        local[id] = ++count;
+
+        if (term.type == ABSTRACTION || term.type == PRIMARY) {
+            if (term.var >= nameIndex.size())
+                nameIndex.resize(term.var + 1, UINT32_MAX);
+
+            if (nameIndex[term.var] == UINT32_MAX) {
+                nameIndex[term.var] = nameCount++;
+                putString(names, symbols.Name(term.var));
+            }
+
+            var = nameIndex[term.var];
+        } else if (term.type == NUMERAL) {
+            var = numeralCount++;
+            putString(numerals, store.NumeralValue(id).ToString());
+        }
+
+        terms += (char)term.type;
+        put(terms, var);
+        if (term.type == ABSTRACTION || term.type == APPLICATION)
+            put(terms, count - local[term.lTerm]);
+        if (term.type == APPLICATION) put(terms, count - local[term.rTerm]);
+    }
+
+    string data(MODULE_MAGIC, sizeof(MODULE_MAGIC));
+    put(data, MODULE_VERSION);
+    put(data, source.size);
+    put(data, source.mtime);
+    put(data, source.hash);
+    put(data, nameCount);
+    data += names;
+    put(data, numeralCount);
+    data += numerals;
+    put(data, count);
+    data += terms;
+    put(data, entries.size());
+
+    for (size_t i = 0; i < entries.size(); i++) {
+        data += (char)entries[i].type;
+        putString(data, entries[i].name);
+        put(data, entries[i].type == ENTRY_LET ? local[entries[i].term] : 0);
+    }
+
+    string temp = filename + "c.XXXXXX";
+    int fd = mkstemp(&temp[0]);
+    if (fd < 0) return;
+
+    bool written = fchmod(fd, 0644) == 0 &&
+                   write(fd, data.data(), data.size()) == (ssize_t)data.size();
+    close(fd);
+
+    if (!written || rename(temp.c_str(), (filename + "c").c_str()) != 0)
+        unlink(temp.c_str());
+}
+
+bool ModuleCache::statSource(const string &filename, ModuleSource &source) {
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0 || !S_ISREG(info.st_mode))
+        return false;
+
+    source.size = info.st_size;
+    source.mtime = (int64_t)info.st_mtim.tv_sec * 1000000000 +
+                   info.st_mtim.tv_nsec;
+    source.hash = 0;
+    return true;
+}
+
+// FNV-1a over the contents of the file.
+bool ModuleCache::hashSource(const string &filename, uint64_t &hash) {
+    ifstream file(filename, ios::binary);
+    if (!file.is_open()) return false;
+
+    char block[65536];
+    hash = 0xCBF29CE484222325ULL;
+
+    while (file.read(block, sizeof(block)) || file.gcount() > 0) {
+        for (streamsize i = 0; i < file.gcount(); i++) {
+            hash ^= (unsigned char)block[i];
+            hash *= 0x100000001B3ULL;
+        }
+    }
+
+    return true;
+}
+
+// Reads a cache file. The source only has to be hashed when its size or
+// modification time has changed since the cache was made.
+bool ModuleCache::readCache(const string &filename, const string &data,
+                            const ModuleSource &source,
+                            vector<ModuleEntry> &entries) {
+    const char *p = data.data() + sizeof(MODULE_MAGIC);
+    const char *end = data.data() + data.size();
+    uint64_t version, size, mtime, hash, count, value;
+    string_view s;
+
+    if (data.size() < sizeof(MODULE_MAGIC) ||
+        memcmp(data.data(), MODULE_MAGIC, sizeof(MODULE_MAGIC)) != 0)
+        return false;
+
+    if (!get(p, end, version) || version != MODULE_VERSION ||
+        !get(p, end, size) || !get(p, end, mtime) || !get(p, end, hash))
+        return false;
+
+    if (size != source.size || (int64_t)mtime != source.mtime) {
+        uint64_t current;
+        if (!hashSource(filename, current) || current != hash) return false;
+    }
+
+    vector<Symbol> names;
+    if (!get(p, end, count)) return false;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (!getString(p, end, s)) return false;
+        names.push_back(symbols.Intern(s));
+    }
+
+    vector<string_view> numerals;
+    if (!get(p, end, count)) return false;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (!getString(p, end, s)) return false;
+        numerals.push_back(s);
+    }
+
+    // loose counts the binders each term needs around it, as Term::loose
+    // does but without saturating, so that a definition can be checked to
+    // be closed.
+    vector<TermId> terms(1, NIL_TERM);
+    vector<uint64_t> loose(1, 0);
+    if (!get(p, end, count)) return false;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (p == end) return false;
+
+        uint64_t type = (unsigned char)*p++;
+        uint64_t var, left = 0, right = 0;
+        if (!get(p, end, var)) return false;
+
+        if (type == ABSTRACTION || type == APPLICATION)
+            if (!get(p, end, left) || left == 0 || left > i) return false;
+        if (type == APPLICATION)
+            if (!get(p, end, right) || right == 0 || right > i) return false;
+
+        TermId lTerm = left > 0 ? terms[terms.size() - left] : NIL_TERM;
+        TermId rTerm = right > 0 ? terms[terms.size() - right] : NIL_TERM;
+        uint64_t lLoose = left > 0 ? loose[loose.size() - left] : 0;
+        uint64_t rLoose = right > 0 ? loose[loose.size() - right] : 0;
+
+        if (type == ABSTRACTION || type == PRIMARY) {
+            if (var >= names.size()) return false;
+            terms.push_back(store.Make((TermType)type, names[var], lTerm,
+                                       NIL_TERM));
+            loose.push_back(type == ABSTRACTION && lLoose > 0 ? lLoose - 1
+                                                              : lLoose);
+        } else if (type == APPLICATION) {
+            terms.push_back(store.Make(APPLICATION, 0, lTerm, rTerm));
+            loose.push_back(lLoose > rLoose ? lLoose : rLoose);
+        } else if (type == INDEX && var < UINT32_MAX) {
+            terms.push_back(store.Make(INDEX, var, NIL_TERM, NIL_TERM));
+            loose.push_back(var + 1);
+        } else if (type == NUMERAL && var < numerals.size()) {
+            terms.push_back(store.MakeNumeral(Natural(string(numerals[var]))));
+            loose.push_back(0);
+        } else {
+            return false;
+        }
+    }
+
+    if (!get(p, end, count)) return false;
+
+    for (uint64_t i = 0; i < count; i++) {
+        if (p == end) return false;
+
+        uint64_t type = (unsigned char)*p++;
+        if (type > ENTRY_LIBRARY || !getString(p, end, s) ||
+            !get(p, end, value) || value >= terms.size())
+            return false;
+
+        // An index no binder of its definition encloses.
+        if (type == ENTRY_LET && (value == 0 || loose[value] > 0))
+            return false;
+
+        entries.push_back({(ModuleEntryType)type, string(s), terms[value]});
+    }
+
+    return p == end;
+}
\ No newline at end of file
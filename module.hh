@@ -0,0 +1,54 @@
+#ifndef __MODULE_H__
+#define __MODULE_H__
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+typedef enum { ENTRY_LET = 0, ENTRY_IMPORT, ENTRY_LIBRARY } ModuleEntryType;
+
+// One thing a module does, in order: bind name to term, import the module
+// file name or import the native library name.
+struct ModuleEntry {
+    ModuleEntryType type;
+    string name;
+    TermId term;
+};
+
+// What a module's cache file was made from: the size and modification time
+// of its source, and a hash of its contents.
+struct ModuleSource {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t hash;
+};
+
+// Keeps parsed modules next to their sources, as name.lmhc beside name.lmh,
+// so that an import need not parse its file again. A cache file holds the
+// names and numerals its terms use, the terms in the order they were made
+// so that children come first, and the entries of the module. It stands for
+// its source as long as the source has the size and modification time it
+// was made from, or failing that the same contents.
+class ModuleCache {
+   public:
+    ModuleCache(TermStore &store, SymbolTable &symbols);
+    bool Load(const string &filename, vector<ModuleEntry> &entries);
+    void Save(const string &filename, const vector<ModuleEntry> &entries);
+
+   private:
+    TermStore &store;
+    SymbolTable &symbols;
+
+    bool statSource(const string &filename, ModuleSource &source);
+    bool hashSource(const string &filename, uint64_t &hash);
+    bool readCache(const string &filename, const string &data,
+                   const ModuleSource &source, vector<ModuleEntry> &entries);
+};
+
+#endif
@@ -0,0 +1,83 @@
+#include "natural.hh"
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+Natural::Natural(uint64_t value) {
+    while (value > 0) {
+        limbs.push_back(value % BASE);
+        value /= BASE;
+    }
+}
+
+Natural::Natural(const string &digits) {
+    for (int end = digits.size(); end > 0; end -= BASE_DIGITS) {
+        int start = end > BASE_DIGITS ? end - BASE_DIGITS : 0;
+        limbs.push_back(stoul(digits.substr(start, end - start)));
+    }
+
+    trim();
+}
+
+int Natural::Compare(const Natural &other) const {
+    if (limbs.size() != other.limbs.size())
+        return limbs.size() < other.limbs.size() ? -1 : 1;
+
+    for (int i = limbs.size() - 1; i >= 0; i--) {
+        if (limbs[i] != other.limbs[i])
+            return limbs[i] < other.limbs[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+// Subtracts other, which must not be greater than this number.
+void Natural::Subtract(const Natural &other) {
+    int64_t borrow = 0;
+
+    for (size_t i = 0; i < limbs.size(); i++) {
+        int64_t limb = (int64_t)limbs[i] - borrow;
+        if (i < other.limbs.size()) limb -= other.limbs[i];
+
+        borrow = limb < 0;
+        limbs[i] = limb + (borrow ? BASE : 0);
+    }
+
+    trim();
+}
+
+bool Natural::ToUint64(uint64_t &value) const {
+    value = 0;
+
+    for (int i = limbs.size() - 1; i >= 0; i--) {
+        if (value > (UINT64_MAX - limbs[i]) / BASE) return false;
+        value = value * BASE + limbs[i];
+    }
+
+    return true;
+}
+
+string Natural::ToString() const {
+    if (limbs.empty()) return "0";
+
+    string res = to_string(limbs.back());
+
+    for (int i = limbs.size() - 2; i >= 0; i--) {
+        string limb = to_string(limbs[i]);
+        res += string(BASE_DIGITS - limb.size(), '0') + limb;
+    }
+
+    return res;
+}
+
+void Natural::trim() {
+    while (!limbs.empty() && limbs.back() == 0) limbs.pop_back();
+}
+
+ostream &operator<<(ostream &out, const Natural &natural) {
+    return out << natural.ToString();
+}
\ No newline at end of file
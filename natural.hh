@@ -0,0 +1,32 @@
+#ifndef __NATURAL_H__
+#define __NATURAL_H__
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// An arbitrary precision natural number, kept as base 10^9 limbs with the
+// least significant first so that reading and printing decimals is cheap.
+class Natural {
+   public:
+    Natural(uint64_t value = 0);
+    explicit Natural(const string &digits);
+    int Compare(const Natural &other) const;
+    void Subtract(const Natural &other);
+    bool ToUint64(uint64_t &value) const;
+    string ToString() const;
+
+   private:
+    static const uint32_t BASE = 1000000000;
+    static const int BASE_DIGITS = 9;
+    vector<uint32_t> limbs;
+
+    void trim();
+};
+
+ostream &operator<<(ostream &out, const Natural &natural);
+
+#endif
@@ -0,0 +1,822 @@
+#include "optimal.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "natural.hh"
+
+using namespace std;
+
+// Largest numeral expanded into the net up front, where fans share it. The
+// expanded form takes a bracket per box for every occurrence of f, which
+// grows with the square of the numeral, so larger ones are only unfolded a
+// layer at a time where they are applied, at the cost of each copy a fan
+// makes unfolding on its own.
+const uint64_t NET_NUMERAL_LIMIT = 1 << 10;
+
+// Most nodes a net may have in use at once; the two nodes of a pair are
+// made again once it is rewritten. Every active pair is rewritten, so a term
+// with a subterm that has no normal form grows without end even when the
+// subterm is thrown away, and a large numeral takes nodes for every layer
+// it is unfolded by.
+const size_t NET_NODE_LIMIT = 1 << 23;
+
+const char NET_MEMORY_ERROR[] = "The optimal engine ran out of memory";
+
+static uint32_t portCount(NetNodeType type) {
+    switch (type) {
+        case N_LAM:
+        case N_APP:
+        case N_FAN:
+            return 3;
+        case N_BRACKET:
+        case N_CROISSANT:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+static bool isControl(NetNodeType type) {
+    return type == N_FAN || type == N_BRACKET || type == N_CROISSANT;
+}
+
+static bool isLeaf(NetNodeType type) {
+    return type == N_FREE || type == N_NUMERAL;
+}
+
+OptimalReducer::OptimalReducer(TermStore &store, SymbolTable &symbols,
+                               const Definitions &definitions,
+                               NumeralNames names, WorkPool *pool)
+    : store(store),
+      symbols(symbols),
+      definitions(definitions),
+      names(names),
+      pool(pool),
+      idle(0),
+      finished(false) {}
+
+// A net or read back that takes more memory than there is is reported like
+// one that outgrows its limit, here and in every worker, rather than left
+// to abort the run.
+TermId OptimalReducer::Normalize(TermId term) {
+    size_t count = pool == NULL ? 1 : pool->Size();
+    for (size_t i = 0; i < count; i++)
+        workers.push_back(unique_ptr<NetWorker>(new NetWorker()));
+
+    NetNode *root = NULL;
+
+    try {
+        root = translate(term);
+    } catch (const bad_alloc &) {
+        netError(NET_MEMORY_ERROR);
+    }
+
+    for (size_t i = 1; i < workers.size(); i++) {
+        workers[i]->task.run = [this, i] { work(i); };
+        pool->Spawn(&workers[i]->task);
+    }
+
+    work(0);
+
+    for (size_t i = 1; i < workers.size(); i++) pool->Wait(&workers[i]->task);
+
+    for (size_t i = 0; i < workers.size(); i++) stats.Add(workers[i]->stats);
+
+    TermId result = NIL_TERM;
+
+    try {
+        result = readBack(root);
+    } catch (const bad_alloc &) {
+        netError(NET_MEMORY_ERROR);
+    }
+
+    workers.clear();
+    items.clear();
+    cells.clear();
+    return result;
+}
+
+const Stats &OptimalReducer::Statistics() { return stats; }
+
+void OptimalReducer::netError(string msg) {
+    cout << "RUNTIME ERROR: " << msg << "\n";
+    exit(1);
+}
+
+NetNode *OptimalReducer::newNode(NetWorker &worker, NetNodeType type,
+                                 uint32_t level, Symbol name) {
+    NetNode *node;
+
+    if (!worker.free.empty()) {
+        node = worker.free.back();
+        worker.free.pop_back();
+    } else {
+        if (worker.nodes.size() >= NET_NODE_LIMIT / workers.size())
+            netError("The net grew past " + to_string(NET_NODE_LIMIT) +
+                     " nodes in use, the most the optimal engine allows; " +
+                     (worker.stats.unfoldings > 0
+                          ? "numerals larger than " +
+                                to_string(NET_NUMERAL_LIMIT) +
+                                " are unfolded a layer at a time, which for "
+                                "this term takes more"
+                          : string("it does not stop on terms with a "
+                                   "subterm that has no normal form")));
+
+        worker.nodes.emplace_back();
+        node = &worker.nodes.back();
+    }
+
+    node->type = type;
+    node->level = level;
+    node->name = name;
+
+    for (int i = 0; i < 3; i++) node->ports[i] = {NULL, 0};
+
+    return node;
+}
+
+// Connects two ports. Two principal ports make an active pair, which the
+// worker that made it goes on to rewrite.
+void OptimalReducer::link(NetWorker &worker, NetPort a, NetPort b) {
+    a.node->ports[a.slot] = b;
+    b.node->ports[b.slot] = a;
+
+    if (a.slot == 0 && b.slot == 0 && a.node->type != N_ROOT &&
+        b.node->type != N_ROOT)
+        worker.pairs.push_back({a.node, b.node});
+}
+
+NetPort OptimalReducer::peer(NetPort port) {
+    return port.node->ports[port.slot];
+}
+
+// Translates term into a net hanging off a root node. An argument sits one
+// box deeper than the application it is passed to, and each variable
+// occurrence leaves the boxes between it and its binder through a croissant
+// and a bracket per box, so that whatever is substituted for it is moved to
+// its depth. The occurrences of a variable meet at fans next to the binder.
+NetNode *OptimalReducer::translate(TermId term) {
+    NetWorker &worker = *workers[0];
+    NetNode *root = newNode(worker, N_ROOT, 0, 0);
+    vector<NetVisit> visits;
+    vector<NetPort> results;
+    vector<NetScope> scopes;
+    vector<Symbol> inlined;
+    visits.push_back({term, 0, false});
+
+    while (!visits.empty()) {
+        NetVisit visit = visits.back();
+        visits.pop_back();
+        Term t = store[visit.term];
+
+        if (visit.expanded) {
+            if (t.type == ABSTRACTION) {
+                NetScope &scope = scopes.back();
+                link(worker, {scope.lam, 1}, results.back());
+                bind(worker, scope, visit.level);
+                results.back() = {scope.lam, 0};
+                scopes.pop_back();
+            } else if (t.type == APPLICATION) {
+                NetNode *app = newNode(worker, N_APP, visit.level, 0);
+                link(worker, {app, 2}, results.back());
+                results.pop_back();
+                link(worker, {app, 0}, results.back());
+                results.back() = {app, 1};
+            } else {
+                inlined.pop_back();
+            }
+
+            continue;
+        }
+
+        switch (t.type) {
+            case ABSTRACTION:
+                scopes.push_back(
+                    {newNode(worker, N_LAM, visit.level, t.var), {}});
+                visits.push_back({visit.term, visit.level, true});
+                visits.push_back({t.lTerm, visit.level, false});
+                break;
+            case APPLICATION:
+                visits.push_back({visit.term, visit.level, true});
+                visits.push_back({t.rTerm, visit.level + 1, false});
+                visits.push_back({t.lTerm, visit.level, false});
+                break;
+            case INDEX: {
+                NetScope &scope = scopes[scopes.size() - 1 - t.var];
+                results.push_back(variable(worker, scope, visit.level,
+                                           scope.lam->level));
+                break;
+            }
+            case PRIMARY: {
+                TermId definition = definitions.Find(t.var);
+
+                if (definition == NIL_TERM) {
+                    NetNode *name = newNode(worker, N_FREE, 0, t.var);
+                    results.push_back({name, 0});
+                    break;
+                }
+
+                if (find(inlined.begin(), inlined.end(), t.var) !=
+                    inlined.end())
+                    netError("The optimal engine cannot inline recursive "
+                             "definition " + symbols.Name(t.var));
+
+                inlined.push_back(t.var);
+                stats.unfoldings++;
+                visits.push_back({visit.term, visit.level, true});
+                visits.push_back({definition, visit.level, false});
+                break;
+            }
+            case NUMERAL: {
+                uint64_t value;
+
+                if (visit.term != term &&
+                    store.NumeralValue(visit.term).ToUint64(value) &&
+                    value <= NET_NUMERAL_LIMIT) {
+                    visits.push_back(
+                        {churchNumeral(value), visit.level, false});
+                    break;
+                }
+
+                results.push_back(
+                    {newNode(worker, N_NUMERAL, 0, visit.term), 0});
+                break;
+            }
+        }
+    }
+
+    link(worker, {root, 0}, results.back());
+    return root;
+}
+
+// Makes an occurrence, at box depth level, of a variable bound at
+// binderLevel and returns the port the occurrence is used from.
+NetPort OptimalReducer::variable(NetWorker &worker, NetScope &scope,
+                                 uint32_t level, uint32_t binderLevel) {
+    NetNode *croissant = newNode(worker, N_CROISSANT, level, 0);
+    NetPort top = {croissant, 0};
+
+    for (uint32_t i = level; i > binderLevel; i--) {
+        NetNode *bracket = newNode(worker, N_BRACKET, i - 1, 0);
+        link(worker, top, {bracket, 1});
+        top = {bracket, 0};
+    }
+
+    scope.uses.push_back(top);
+    return {croissant, 1};
+}
+
+// Joins the occurrences of a bound variable to its abstraction, through a
+// chain of fans if there are several and an eraser if there are none.
+void OptimalReducer::bind(NetWorker &worker, NetScope &scope,
+                          uint32_t level) {
+    NetPort target = {scope.lam, 2};
+
+    if (scope.uses.empty()) {
+        link(worker, target, {newNode(worker, N_ERASE, level, 0), 0});
+        return;
+    }
+
+    for (size_t i = 0; i + 1 < scope.uses.size(); i++) {
+        NetNode *fan = newNode(worker, N_FAN, level, 0);
+        link(worker, target, {fan, 0});
+        link(worker, {fan, 1}, scope.uses[i]);
+        target = {fan, 2};
+    }
+
+    link(worker, target, scope.uses.back());
+}
+
+TermId OptimalReducer::churchNumeral(uint64_t value) {
+    TermId f = store.Make(INDEX, 1, NIL_TERM, NIL_TERM);
+    TermId body = store.Make(INDEX, 0, NIL_TERM, NIL_TERM);
+
+    for (uint64_t i = 0; i < value; i++)
+        body = store.Make(APPLICATION, 0, f, body);
+
+    body = store.Make(ABSTRACTION, names.x, body, NIL_TERM);
+    return store.Make(ABSTRACTION, names.f, body, NIL_TERM);
+}
+
+// Builds the outermost layer of the church form of a numeral at box depth
+// level: !f.!x.x for zero, and otherwise !f.!x.f (pred f x) with pred left a
+// numeral. Workers only touch the store here, one at a time.
+NetPort OptimalReducer::unfold(NetWorker &worker, TermId numeral,
+                               uint32_t level) {
+    TermId pred = NIL_TERM;
+
+    {
+        lock_guard<mutex> guard(storeLock);
+        if (!store.IsZero(numeral)) pred = store.Predecessor(numeral);
+    }
+
+    NetScope f = {newNode(worker, N_LAM, level, names.f), {}};
+    NetScope x = {newNode(worker, N_LAM, level, names.x), {}};
+    link(worker, {f.lam, 1}, {x.lam, 0});
+    NetPort body;
+
+    if (pred == NIL_TERM) {
+        body = variable(worker, x, level, level);
+    } else {
+        NetNode *outer = newNode(worker, N_APP, level, 0);
+        NetNode *inner = newNode(worker, N_APP, level + 1, 0);
+        NetNode *head = newNode(worker, N_APP, level + 1, 0);
+        link(worker, {outer, 0}, variable(worker, f, level, level));
+        link(worker, {outer, 2}, {inner, 1});
+        link(worker, {inner, 0}, {head, 1});
+        link(worker, {inner, 2}, variable(worker, x, level + 2, level));
+        link(worker, {head, 0}, {newNode(worker, N_NUMERAL, 0, pred), 0});
+        link(worker, {head, 2}, variable(worker, f, level + 2, level));
+        body = {outer, 1};
+    }
+
+    link(worker, {x.lam, 1}, body);
+    bind(worker, x, level);
+    bind(worker, f, level);
+    return {f.lam, 0};
+}
+
+// Rewrites active pairs until there are none left anywhere. A worker works
+// through the pairs its own rewrites make, handing some over while others
+// are idle. A pair that touches a node another worker holds is put back to
+// be tried again.
+void OptimalReducer::work(size_t index) {
+    NetWorker &worker = *workers[index];
+
+    try {
+        while (!worker.pairs.empty() || takeShared(worker)) {
+            NetPair pair = worker.pairs.back();
+            worker.pairs.pop_back();
+
+            if (!interact(worker, pair)) {
+                {
+                    lock_guard<mutex> guard(sharedLock);
+                    shared.push_back(pair);
+                }
+
+                changed.notify_one();
+                this_thread::yield();
+            }
+
+            share(worker);
+        }
+    } catch (const bad_alloc &) {
+        netError(NET_MEMORY_ERROR);
+    }
+}
+
+// Waits for a shared pair. Once every worker is waiting there is nothing
+// left to rewrite.
+bool OptimalReducer::takeShared(NetWorker &worker) {
+    unique_lock<mutex> guard(sharedLock);
+    idle++;
+
+    while (shared.empty() && !finished) {
+        if (idle == workers.size()) {
+            finished = true;
+            changed.notify_all();
+            break;
+        }
+
+        changed.wait(guard);
+    }
+
+    idle--;
+    if (shared.empty()) return false;
+
+    worker.pairs.push_back(shared.back());
+    shared.pop_back();
+    return true;
+}
+
+void OptimalReducer::share(NetWorker &worker) {
+    if (idle == 0 || worker.pairs.size() < 2) return;
+
+    {
+        lock_guard<mutex> guard(sharedLock);
+        size_t half = worker.pairs.size() / 2;
+        shared.insert(shared.end(), worker.pairs.begin(),
+                      worker.pairs.begin() + half);
+        worker.pairs.erase(worker.pairs.begin(), worker.pairs.begin() + half);
+    }
+
+    changed.notify_all();
+}
+
+// Rewrites one active pair once it holds both nodes and every neighbour a
+// rewrite may reconnect. Returns false, holding nothing, if another worker
+// has any of them.
+bool OptimalReducer::interact(NetWorker &worker, NetPair pair) {
+    NetNode *pairNodes[2] = {pair.a, pair.b};
+    bool held = true;
+    worker.held.clear();
+
+    for (int i = 0; i < 2 && held; i++) held = lockNode(worker, pairNodes[i]);
+
+    for (int i = 0; i < 2 && held; i++) {
+        for (uint32_t s = 1; s < portCount(pairNodes[i]->type) && held; s++) {
+            NetNode *neighbour = pairNodes[i]->ports[s].node;
+
+            if (find(worker.held.begin(), worker.held.end(), neighbour) ==
+                worker.held.end())
+                held = lockNode(worker, neighbour);
+        }
+    }
+
+    if (held) rewrite(worker, pair.a, pair.b);
+
+    for (size_t i = 0; i < worker.held.size(); i++)
+        worker.held[i]->locked.store(false, memory_order_release);
+
+    return held;
+}
+
+bool OptimalReducer::lockNode(NetWorker &worker, NetNode *node) {
+    if (node->locked.exchange(true, memory_order_acquire)) return false;
+    worker.held.push_back(node);
+    return true;
+}
+
+// Applies the interaction rule for a and b. The rule says what takes the
+// place of each auxiliary port of the pair: a port of a new node, or
+// another auxiliary port the wire passes straight through to. The wires
+// are then followed through the pair to reconnect their far ends.
+//
+// A lambda meeting an application is a beta step. Two control nodes of the
+// same kind and level cancel out. Otherwise the control node of the lower
+// level moves through the other node: a fan duplicates it, a bracket puts it
+// one box deeper and a croissant one box shallower. Erasers, free names and
+// numerals are absorbed or copied by whatever they meet, except that an
+// application unfolds a numeral by one layer into the net. The worker makes
+// the nodes of the pair again in later rewrites, once it no longer holds
+// them.
+void OptimalReducer::rewrite(NetWorker &worker, NetNode *a, NetNode *b) {
+    NetPort slots[4];
+    NetPort outer[4];
+    NetPort inner[4];
+    int through[4];
+    int count = 0;
+
+    for (NetNode *node : {a, b}) {
+        for (uint32_t s = 1; s < portCount(node->type); s++) {
+            slots[count] = {node, s};
+            outer[count] = node->ports[s];
+            through[count] = -1;
+            count++;
+        }
+    }
+
+    auto slotOf = [&](NetNode *node, uint32_t s) {
+        for (int i = 0; i < count; i++)
+            if (slots[i].node == node && slots[i].slot == s) return i;
+        return -1;
+    };
+    auto pass = [&](int i, int j) {
+        through[i] = j;
+        through[j] = i;
+    };
+
+    if ((a->type == N_LAM && b->type == N_APP) ||
+        (a->type == N_APP && b->type == N_LAM)) {
+        NetNode *lam = a->type == N_LAM ? a : b;
+        NetNode *app = a->type == N_LAM ? b : a;
+        pass(slotOf(lam, 1), slotOf(app, 1));
+        pass(slotOf(lam, 2), slotOf(app, 2));
+        worker.stats.betaSteps++;
+    } else if (a->type == N_ERASE || b->type == N_ERASE) {
+        NetNode *erased = a->type == N_ERASE ? b : a;
+
+        for (uint32_t s = 1; s < portCount(erased->type); s++)
+            inner[slotOf(erased, s)] = {
+                newNode(worker, N_ERASE, erased->level, 0), 0};
+    } else if (isLeaf(a->type) || isLeaf(b->type)) {
+        NetNode *leaf = isLeaf(a->type) ? a : b;
+        NetNode *other = isLeaf(a->type) ? b : a;
+
+        if (leaf->type == N_NUMERAL && other->type == N_APP) {
+            NetNode *app = newNode(worker, N_APP, other->level, 0);
+            inner[slotOf(other, 1)] = {app, 1};
+            inner[slotOf(other, 2)] = {app, 2};
+            link(worker, {app, 0}, unfold(worker, leaf->name, other->level));
+            worker.stats.unfoldings++;
+        } else if (isControl(other->type)) {
+            for (uint32_t s = 1; s < portCount(other->type); s++)
+                inner[slotOf(other, s)] = {
+                    newNode(worker, leaf->type, 0, leaf->name), 0};
+        } else {
+            return;
+        }
+    } else if (isControl(a->type) && a->type == b->type &&
+               a->level == b->level) {
+        for (uint32_t s = 1; s < portCount(a->type); s++)
+            pass(slotOf(a, s), slotOf(b, s));
+    } else {
+        NetNode *control;
+        NetNode *other;
+
+        if (isControl(a->type) && b->level > a->level) {
+            control = a;
+            other = b;
+        } else if (isControl(b->type) && a->level > b->level) {
+            control = b;
+            other = a;
+        } else {
+            return;
+        }
+
+        uint32_t ports = portCount(other->type);
+
+        if (control->type == N_FAN) {
+            NetNode *copies[2];
+
+            for (uint32_t c = 0; c < 2; c++) {
+                copies[c] =
+                    newNode(worker, other->type, other->level, other->name);
+                inner[slotOf(control, c + 1)] = {copies[c], 0};
+            }
+
+            for (uint32_t s = 1; s < ports; s++) {
+                NetNode *fan = newNode(worker, N_FAN, control->level, 0);
+                inner[slotOf(other, s)] = {fan, 0};
+                link(worker, {fan, 1}, {copies[0], s});
+                link(worker, {fan, 2}, {copies[1], s});
+            }
+
+            worker.stats.nodesCopied += 2;
+        } else {
+            uint32_t level = control->type == N_BRACKET ? other->level + 1
+                                                        : other->level - 1;
+            NetNode *moved =
+                newNode(worker, other->type, level, other->name);
+            inner[slotOf(control, 1)] = {moved, 0};
+
+            for (uint32_t s = 1; s < ports; s++) {
+                NetNode *next =
+                    newNode(worker, control->type, control->level, 0);
+                inner[slotOf(other, s)] = {next, 0};
+                link(worker, {next, 1}, {moved, s});
+            }
+        }
+    }
+
+    // Follows a wire outwards from slot i to the port at its far end, or
+    // returns a NULL port if it only loops back through the pair.
+    bool done[4] = {false, false, false, false};
+    auto farEnd = [&](int i) -> NetPort {
+        for (int hops = 0; hops <= count; hops++) {
+            done[i] = true;
+            int j = slotOf(outer[i].node, outer[i].slot);
+            if (j < 0) return outer[i];
+
+            done[j] = true;
+            if (through[j] < 0) return inner[j];
+            i = through[j];
+        }
+
+        return {NULL, 0};
+    };
+
+    for (int i = 0; i < count; i++) {
+        if (done[i]) continue;
+
+        NetPort outside = farEnd(i);
+        NetPort inside = through[i] < 0 ? inner[i] : farEnd(through[i]);
+        done[i] = true;
+
+        if (outside.node != NULL && inside.node != NULL)
+            link(worker, outside, inside);
+    }
+
+    worker.free.push_back(a);
+    worker.free.push_back(b);
+}
+
+int OptimalReducer::newItem(LevelItemType type, int first, int second,
+                            int next) {
+    items.push_back({type, first, second, next});
+    return items.size() - 1;
+}
+
+bool OptimalReducer::sameLevel(int a, int b) {
+    while (a >= 0 && b >= 0) {
+        if (a == b) return true;
+
+        LevelItem x = items[a];
+        LevelItem y = items[b];
+        if (x.type != y.type) return false;
+        if (x.type == L_PORT && x.first != y.first) return false;
+        if (x.type == L_PAIR &&
+            (!sameLevel(x.first, y.first) || !sameLevel(x.second, y.second)))
+            return false;
+
+        a = x.next;
+        b = y.next;
+    }
+
+    return a == b;
+}
+
+int OptimalReducer::levelAt(int context, uint32_t level) {
+    uint32_t size = context < 0 ? 0 : cells[context].size;
+    if (level >= size) return -1;
+
+    for (; size > level + 1; size--) context = cells[context].next;
+    return cells[context].level;
+}
+
+// Returns context with removed levels from level on taken out and the
+// levels in added put in their place. The cells below level are shared.
+int OptimalReducer::splice(int context, uint32_t level, uint32_t removed,
+                           initializer_list<int> added) {
+    uint32_t size = context < 0 ? 0 : cells[context].size;
+    prefix.clear();
+
+    for (; size > level; size--) {
+        prefix.push_back(cells[context].level);
+        context = cells[context].next;
+    }
+
+    for (uint32_t i = 0; i < removed && !prefix.empty(); i++)
+        prefix.pop_back();
+
+    auto push = [&](int value) {
+        cells.push_back({value, context, ++size});
+        context = cells.size() - 1;
+    };
+
+    while (size < level) push(-1);
+    for (int value : added) push(value);
+    for (size_t i = prefix.size(); i > 0; i--) push(prefix[i - 1]);
+    return context;
+}
+
+// Compares the levels below levels of two contexts. Contexts that come to
+// the same cell agree from there on.
+bool OptimalReducer::sameContext(int a, int b, uint32_t levels) {
+    uint32_t aSize = a < 0 ? 0 : cells[a].size;
+    uint32_t bSize = b < 0 ? 0 : cells[b].size;
+
+    for (; aSize > levels; aSize--) a = cells[a].next;
+    for (; bSize > levels; bSize--) b = cells[b].next;
+
+    while (a != b) {
+        bool aDeeper = aSize >= bSize;
+        bool bDeeper = bSize >= aSize;
+        if (!sameLevel(aDeeper ? cells[a].level : -1,
+                       bDeeper ? cells[b].level : -1))
+            return false;
+
+        if (aDeeper) {
+            a = cells[a].next;
+            aSize--;
+        }
+        if (bDeeper) {
+            b = cells[b].next;
+            bSize--;
+        }
+    }
+
+    return true;
+}
+
+// Moves a read back path through the control node port arrives at and
+// updates its context: a fan records on its level which side the path came
+// in from, and takes the path back out the same side; a croissant opens a
+// new level and a bracket folds two levels into one.
+void OptimalReducer::step(NetPort &port, int &context) {
+    NetNode *node = port.node;
+    uint32_t level = node->level;
+
+    if (node->type == N_FAN) {
+        int top = levelAt(context, level);
+
+        if (port.slot != 0) {
+            context = splice(context, level, 1,
+                             {newItem(L_PORT, port.slot, 0, top)});
+            port = peer({node, 0});
+        } else {
+            if (top < 0 || items[top].type != L_PORT)
+                netError("Unable to read back the interaction net");
+
+            context = splice(context, level, 1, {items[top].next});
+            port = peer({node, (uint32_t)items[top].first});
+        }
+    } else if (node->type == N_CROISSANT) {
+        if (port.slot != 0) {
+            context = splice(context, level, 0, {0});
+            port = peer({node, 0});
+        } else {
+            context = splice(context, level, 1, {});
+            port = peer({node, 1});
+        }
+    } else {
+        if (port.slot != 0) {
+            int pair = newItem(L_PAIR, levelAt(context, level),
+                               levelAt(context, level + 1), -1);
+            context = splice(context, level, 2, {pair});
+            port = peer({node, 0});
+        } else {
+            int top = levelAt(context, level);
+            if (top >= 0 && items[top].type != L_PAIR)
+                netError("Unable to read back the interaction net");
+
+            context = splice(context, level, 1,
+                             {top < 0 ? -1 : items[top].first,
+                              top < 0 ? -1 : items[top].second});
+            port = peer({node, 1});
+        }
+    }
+}
+
+// Reads the normal form back by following paths down from the root. An
+// abstraction is only reached through its bound variable along a path that
+// passed through the same copy of it, which is the one whose context agrees
+// on the levels outside it. What following a path adds to the level items
+// and contexts is only used by the paths below it, so it is dropped once
+// they are read. Item 0 is the mark of every croissant.
+TermId OptimalReducer::readBack(NetNode *root) {
+    vector<NetRead> reads;
+    vector<TermId> results;
+    vector<NetBinder> binders;
+    items.assign(1, {L_STAR, 0, 0, -1});
+    reads.push_back({R_PORT, peer({root, 0}), -1, 0, 0});
+
+    while (!reads.empty()) {
+        NetRead read = reads.back();
+        reads.pop_back();
+
+        if (read.type == R_ABS) {
+            TermId body = results.back();
+            results.back() = store.Make(ABSTRACTION, binders.back().lam->name,
+                                        body, NIL_TERM);
+            binders.pop_back();
+        } else if (read.type == R_APP) {
+            TermId rTerm = results.back();
+            results.pop_back();
+            results.back() =
+                store.Make(APPLICATION, 0, results.back(), rTerm);
+        }
+
+        if (read.type != R_PORT) {
+            items.resize(read.items);
+            cells.resize(read.cells);
+            continue;
+        }
+
+        NetPort port = read.port;
+        int context = read.context;
+        size_t itemMark = items.size();
+        size_t cellMark = cells.size();
+        while (isControl(port.node->type)) step(port, context);
+
+        NetNode *node = port.node;
+
+        if (node->type == N_LAM && port.slot == 0) {
+            binders.push_back({node, context});
+            reads.push_back({R_ABS, port, -1, itemMark, cellMark});
+            reads.push_back({R_PORT, peer({node, 1}), context, 0, 0});
+            continue;
+        } else if (node->type == N_APP && port.slot == 1) {
+            reads.push_back({R_APP, port, -1, itemMark, cellMark});
+            reads.push_back({R_PORT, peer({node, 2}), context, 0, 0});
+            reads.push_back({R_PORT, peer({node, 0}), context, 0, 0});
+            continue;
+        } else if (node->type == N_LAM && port.slot == 2) {
+            size_t i = binders.size();
+
+            while (i > 0) {
+                NetBinder &binder = binders[i - 1];
+                if (binder.lam == node &&
+                    sameContext(binder.context, context, node->level))
+                    break;
+                i--;
+            }
+
+            if (i == 0) netError("Unable to read back the interaction net");
+            results.push_back(store.Make(INDEX, binders.size() - i, NIL_TERM,
+                                         NIL_TERM));
+        } else if (node->type == N_FREE) {
+            results.push_back(
+                store.Make(PRIMARY, node->name, NIL_TERM, NIL_TERM));
+        } else if (node->type == N_NUMERAL) {
+            results.push_back(node->name);
+        } else {
+            netError("Unable to read back the interaction net");
+        }
+
+        items.resize(itemMark);
+        cells.resize(cellMark);
+    }
+
+    return results.back();
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+#ifndef __OPTIMAL_H__
+#define __OPTIMAL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "definitions.hh"
+#include "pool.hh"
+#include "stats.hh"
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+typedef enum {
+    N_ROOT = 0,
+    N_LAM,
+    N_APP,
+    N_FAN,
+    N_BRACKET,
+    N_CROISSANT,
+    N_ERASE,
+    N_FREE,
+    N_NUMERAL
+} NetNodeType;
+
+struct NetNode;
+
+struct NetPort {
+    NetNode *node;
+    uint32_t slot;
+};
+
+// A node of the interaction net. Port 0 is the principal port. LAM has its
+// body on port 1 and its bound variable on port 2, APP its function on the
+// principal port, its result on port 1 and its argument on port 2. FAN,
+// BRACKET and CROISSANT are the control nodes that share, open and close
+// the box around an argument; level is the box depth a node works at. A
+// FREE node is a free name, kept in name, and a NUMERAL node a numeral not
+// yet unfolded, whose term is kept in name.
+struct NetNode {
+    NetNodeType type;
+    uint32_t level;
+    Symbol name;
+    NetPort ports[3];
+    atomic<bool> locked{false};
+};
+
+struct NetPair {
+    NetNode *a;
+    NetNode *b;
+};
+
+// The nodes a worker made, those of them its rewrites have used up and it
+// can make again, and the active pairs it is working through.
+struct NetWorker {
+    deque<NetNode> nodes;
+    vector<NetNode *> free;
+    vector<NetPair> pairs;
+    vector<NetNode *> held;
+    Task task;
+    Stats stats;
+};
+
+// A term being translated: the subterm, its box depth, and once its
+// children are done, which of them to wire up.
+struct NetVisit {
+    TermId term;
+    uint32_t level;
+    bool expanded;
+};
+
+// The variables in scope while translating: each abstraction collects the
+// ports its occurrences hang off until its body is done.
+struct NetScope {
+    NetNode *lam;
+    vector<NetPort> uses;
+};
+
+typedef enum { L_PORT = 0, L_STAR, L_PAIR } LevelItemType;
+
+// An entry of one level of a read back context: the side a fan was entered
+// from, the mark a croissant leaves, or two levels a bracket folded into one.
+// Levels are persistent lists, so contexts share their tails.
+struct LevelItem {
+    LevelItemType type;
+    int first;
+    int second;
+    int next;
+};
+
+// A cell of a read back context, which is a persistent list of the levels
+// of the boxes a path is in, deepest first. size counts the levels from the
+// cell down, so the cell holds level size - 1; levels past the deepest are
+// empty. Control nodes mostly change the deepest levels, and only rebuild
+// the cells down to the one they change, so the paths a read back splits
+// into share the rest.
+struct ContextCell {
+    int level;
+    int next;
+    uint32_t size;
+};
+
+typedef enum { R_PORT = 0, R_ABS, R_APP } NetReadType;
+
+// A path to read from, or a term to finish once the paths below it are
+// read, along with how many level items and context cells there were before
+// its own path was followed, which is all that is left in use after it.
+struct NetRead {
+    NetReadType type;
+    NetPort port;
+    int context;
+    size_t items;
+    size_t cells;
+};
+
+struct NetBinder {
+    NetNode *lam;
+    int context;
+};
+
+// An experimental optimal reducer after Lamping and Gonthier, Abadi and
+// Levy. The term becomes an interaction net whose arguments are boxes
+// delimited by brackets and croissants, so that fans only ever duplicate
+// what is shared and no redex is reduced twice, even under abstractions.
+// Every rewrite is local to one active pair, so with a pool several workers
+// rewrite disjoint pairs at once. The normal form is read back by following
+// paths through the net with the context semantics of the control nodes.
+// Definitions are inlined, so recursive ones are not supported. A path to a
+// variable deep in the result passes the control nodes of every box above
+// it, so reading back takes time growing with the square of the depth.
+class OptimalReducer {
+   public:
+    OptimalReducer(TermStore &store, SymbolTable &symbols,
+                   const Definitions &definitions, NumeralNames names,
+                   WorkPool *pool = NULL);
+    TermId Normalize(TermId term);
+    const Stats &Statistics();
+
+   private:
+    TermStore &store;
+    SymbolTable &symbols;
+    const Definitions &definitions;
+    NumeralNames names;
+    WorkPool *pool;
+    vector<unique_ptr<NetWorker>> workers;
+    mutex sharedLock;
+    condition_variable changed;
+    vector<NetPair> shared;
+    atomic<size_t> idle;
+    bool finished;
+    vector<LevelItem> items;
+    vector<ContextCell> cells;
+    vector<int> prefix;
+    mutex storeLock;
+    Stats stats;
+
+    void netError(string msg);
+    NetNode *newNode(NetWorker &worker, NetNodeType type, uint32_t level,
+                     Symbol name);
+    void link(NetWorker &worker, NetPort a, NetPort b);
+    NetPort peer(NetPort port);
+    NetNode *translate(TermId term);
+    NetPort variable(NetWorker &worker, NetScope &scope, uint32_t level,
+                     uint32_t binderLevel);
+    void bind(NetWorker &worker, NetScope &scope, uint32_t level);
+    TermId churchNumeral(uint64_t value);
+    NetPort unfold(NetWorker &worker, TermId numeral, uint32_t level);
+    void work(size_t index);
+    bool takeShared(NetWorker &worker);
+    void share(NetWorker &worker);
+    bool interact(NetWorker &worker, NetPair pair);
+    bool lockNode(NetWorker &worker, NetNode *node);
+    void rewrite(NetWorker &worker, NetNode *a, NetNode *b);
+    int newItem(LevelItemType type, int first, int second, int next);
+    bool sameLevel(int a, int b);
+    int levelAt(int context, uint32_t level);
+    int splice(int context, uint32_t level, uint32_t removed,
+               initializer_list<int> added);
+    bool sameContext(int a, int b, uint32_t levels);
+    void step(NetPort &port, int &context);
+    TermId readBack(NetNode *root);
+};
+
+#endif
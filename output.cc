@@ -0,0 +1,49 @@
+#include "output.hh"
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+Output::Output(string *target) : target(target), buffer(OUTPUT_BUFFER) {
+    next = buffer.data();
+    limit = next + buffer.size();
+}
+
+Output::~Output() { Drain(); }
+
+// Hands on what is buffered. Text for standard output only goes as far as
+// its stdio buffer, where it keeps its place before anything cout writes.
+void Output::Drain() {
+    pass(buffer.data(), next - buffer.data());
+    next = buffer.data();
+}
+
+void Output::Flush() {
+    Drain();
+    if (target == NULL) fflush(stdout);
+}
+
+// Text longer than the buffer skips it.
+void Output::writeLong(string_view text) {
+    Drain();
+
+    if (text.size() >= buffer.size()) {
+        pass(text.data(), text.size());
+        return;
+    }
+
+    memcpy(next, text.data(), text.size());
+    next += text.size();
+}
+
+void Output::pass(const char *text, size_t length) {
+    if (length == 0) return;
+
+    if (target != NULL)
+        target->append(text, length);
+    else
+        fwrite(text, 1, length, stdout);
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef __OUTPUT_H__
+#define __OUTPUT_H__
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Bytes of text an output holds before handing them on.
+const size_t OUTPUT_BUFFER = 1 << 20;
+
+// A large buffer the printers write results straight into, handed on a
+// buffer at a time: to standard output, or to a string that keeps a result
+// until it can be written in order. Standard output is shared with cout, so
+// text handed to it stays in order with messages written there, and only
+// leaves the process on Flush or at exit.
+class Output {
+   public:
+    Output(string *target = NULL);
+    ~Output();
+    void Drain();
+    void Flush();
+
+    void Write(string_view text) {
+        if (text.size() > (size_t)(limit - next)) {
+            writeLong(text);
+            return;
+        }
+
+        memcpy(next, text.data(), text.size());
+        next += text.size();
+    }
+
+    void Put(char c) {
+        if (next == limit) Drain();
+        *next++ = c;
+    }
+
+   private:
+    string *target;
+    vector<char> buffer;
+    char *next;
+    char *limit;
+
+    void writeLong(string_view text);
+    void pass(const char *text, size_t length);
+};
+
+#endif
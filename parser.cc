@@ -1,643 +1,625 @@
-
-#include "parser.hh"
-
-#include <fstream>
-#include <iostream>
-
-#include "libraries.hh"
-
-using namespace std;
-
-void Parser::importError(string msg) {
-    cout << "IMPORT ERROR: " << msg << "\n";
-    exit(1);
-}
-
-void Parser::syntaxError(int lineNum, string msg) {
-    cout << "SYNTAX ERROR (" << lineNum << "): " << msg << "\n";
-    exit(1);
-}
-
-void Parser::runtimeError(string msg) {
-    cout << "RUNTIME ERROR: " << msg << "\n";
-    exit(1);
-}
-
-void Parser::expect(TokenType type, string msg) {
-    Token t = lexer.GetToken();
-    if (t.tokenType != type) syntaxError(t.lineNum, msg);
-}
-
-void Parser::checkType(Token token, TokenType type, string msg) {
-    if (token.tokenType != type) syntaxError(token.lineNum, msg);
-}
-
-bool Parser::OpenFile(string filename) { return lexer.OpenFile(filename); }
-
-void Parser::ParseInput() { parseProgram(); }
-
-void Parser::ReduceAndPrint() {
-    for (long unsigned int i = 0; i < reductions.size(); i++) {
-        Term *reduction = reductions[i];
-        bool reduce = true;
-
-        while (reduce) {
-            reduce = false;
-            reduce |= substituteDefs(reduction);
-            reduce |= betaReduce(reduction);
-            reduce |= collapseParentheses(reduction);
-        }
-
-        switch (printTypes[i]) {
-            case PRINT_FUNC:
-                cout << termToString(reduction) << endl;
-                break;
-            case PRINT_BOOL:
-                cout << (termToBool(reduction) ? "true" : "false") << endl;
-                break;
-            case PRINT_NUM:
-                cout << termToNum(reduction) << endl;
-                break;
-        }
-    }
-}
-
-void Parser::parseProgram() {
-    Token t = lexer.Peek();
-    if (t.tokenType == LET || t.tokenType == IMPORT) parseDefList();
-
-    parseReductionList();
-    expect(END_OF_FILE, "Expected end of file");
-}
-
-void Parser::parseDefList() {
-    parseDef();
-
-    Token t = lexer.Peek();
-    if (t.tokenType == LET || t.tokenType == IMPORT) parseDefList();
-}
-
-void Parser::parseDef() {
-    Token t = lexer.Peek();
-
-    if (t.tokenType == IMPORT) {
-        parseImport();
-    } else {
-        expect(LET, "Expected 'let'");
-
-        Token t = lexer.GetToken();
-        checkType(t, ID, "Expected definition name");
-        string var = t.lexeme;
-
-        expect(EQUAL, "Expected '='");
-
-        Term *term = parseTerm();
-        definitions[var] = term;
-
-        expect(SEMICOLON, "Expected semicolon");
-    }
-}
-
-void Parser::parseImport() {
-    string importName;
-    bool isFile;
-
-    expect(IMPORT, "Expected 'import'");
-
-    Token id = lexer.GetToken();
-    checkType(id, ID, "Expected import name");
-
-    Token t = lexer.Peek();
-    if (t.tokenType == DOT) {
-        lexer.UngetToken(id);
-        importName = parseFilename();
-        isFile = true;
-    } else {
-        importName = id.lexeme;
-        isFile = false;
-    }
-
-    expect(SEMICOLON, "Expected semicolon");
-
-    if (isFile) {
-        ifstream file;
-        file.open(importName);
-
-        if (!file.is_open())
-            importError(importName + " not found in local directory");
-
-        string fileData = "";
-        char c;
-
-        while (file.get(c)) fileData += c;
-        lexer.UnshiftString(fileData);
-    } else {
-        if (LIBRARIES.find(importName) == LIBRARIES.end())
-            importError(importName + " is not a native library");
-
-        lexer.UnshiftString(LIBRARIES.at(importName));
-    }
-}
-
-string Parser::parseFilename() {
-    Token id = lexer.GetToken();
-    checkType(id, ID, "Expected import file name");
-
-    expect(DOT, "Expected '.");
-
-    Token ext = lexer.GetToken();
-    checkType(ext, HEADER_EXTENSION, "Expected header extension");
-
-    return id.lexeme + "." + ext.lexeme;
-}
-
-void Parser::parseReductionList() {
-    parseReduction();
-
-    Token t = lexer.Peek();
-
-    if (t.tokenType != END_OF_FILE) {
-        parseReductionList();
-    }
-}
-
-void Parser::parseReduction() {
-    PrintType printType = parsePrint();
-    printTypes.push_back(printType);
-
-    Term *term = parseTerm();
-    reductions.push_back(term);
-
-    expect(SEMICOLON, "Expected semicolon");
-}
-
-PrintType Parser::parsePrint() {
-    Token t = lexer.GetToken();
-    checkType(t, PRINT, "Expected print type");
-
-    if (t.lexeme.compare("print") == 0)
-        return PRINT_FUNC;
-    else if (t.lexeme.compare("printnum") == 0)
-        return PRINT_NUM;
-    else if (t.lexeme.compare("printbool") == 0)
-        return PRINT_BOOL;
-
-    syntaxError(t.lineNum, "Invalid print type");
-}
-
-Term *Parser::parseTerm() {
-    Token t = lexer.Peek();
-    Term *term = new Term;
-    term->var = "";
-    term->lTerm = NULL;
-    term->rTerm = NULL;
-
-    switch (t.tokenType) {
-        case LAMBDA:
-            term->type = ABSTRACTION;
-
-            expect(LAMBDA, "Expected '!'");
-
-            t = lexer.GetToken();
-            checkType(t, ID, "Expected variable name");
-            term->var = t.lexeme;
-
-            expect(DOT, "Expected '.'");
-
-            term->lTerm = parseTerm();
-            break;
-        case LPAREN:
-            term->type = APPLICATION;
-
-            expect(LPAREN, "Expected ')'");
-            term->lTerm = parseTerm();
-            expect(RPAREN, "Expected ')'");
-
-            t = lexer.Peek();
-
-            if (t.tokenType != RPAREN && t.tokenType != SEMICOLON &&
-                t.tokenType != END_OF_FILE) {
-                term->rTerm = parseTerm();
-            }
-            break;
-        case ID:
-        case NUM:
-            if (t.tokenType == ID) {
-                term->type = PRIMARY;
-                term->var = parsePrimary();
-            } else {
-                term->type = APPLICATION;
-                term->lTerm = numToTerm(stoi(parsePrimary()));
-            }
-
-            t = lexer.Peek();
-
-            if (t.tokenType != RPAREN && t.tokenType != SEMICOLON &&
-                t.tokenType != END_OF_FILE) {
-                term->rTerm = parseTerm();
-            }
-            break;
-        default:
-            syntaxError(t.lineNum, "Unable to parse term");
-    }
-
-    return term;
-}
-
-string Parser::parsePrimary() {
-    Token t = lexer.GetToken();
-    if (t.tokenType != ID && t.tokenType != NUM)
-        syntaxError(t.lineNum, "Primary must be alphanumeric");
-    return t.lexeme;
-}
-
-void Parser::parseComment() {}
-
-bool Parser::betaReduce(Term *term) {
-    if (term == NULL) return false;
-    bool changed = false;
-
-    switch (term->type) {
-        case APPLICATION:
-            if (term->rTerm == NULL) {
-                changed |= betaReduce(term->lTerm);
-            } else if (term->lTerm->type != ABSTRACTION) {
-                changed |= betaReduce(term->lTerm);
-                changed |= betaReduce(term->rTerm);
-            } else {
-                Term *application = term;
-                Term *abstraction = application->lTerm;
-                Term *arg = application->rTerm;
-                string var = abstraction->var;
-                Term *termToSub;
-
-                if (arg->type == ABSTRACTION) {
-                    termToSub = arg;
-                    application->rTerm = NULL;
-                } else if (arg->type == APPLICATION) {
-                    termToSub = arg->lTerm;
-                    application->rTerm = arg->rTerm;
-                } else if (arg->type == PRIMARY) {
-                    termToSub = new Term;
-                    termToSub->type = PRIMARY;
-                    termToSub->var = arg->var;
-                    termToSub->lTerm = NULL;
-                    termToSub->rTerm = NULL;
-                    application->rTerm = arg->rTerm;
-                }
-
-                map<string, bool> freeVars;
-                map<string, string> renames;
-                getFreeVars(termToSub, freeVars);
-                alphaRename(abstraction, freeVars, renames);
-                substituteVars(abstraction->lTerm, abstraction->var, termToSub);
-
-                application->lTerm = abstraction->lTerm;
-                delete abstraction;
-                delete arg;
-                changed |= true;
-            }
-            break;
-        case PRIMARY:
-            if (term->rTerm != NULL) {
-                changed |= betaReduce(term->rTerm);
-            }
-            break;
-        case ABSTRACTION:
-            changed |= betaReduce(term->lTerm);
-            break;
-    }
-
-    return changed;
-}
-
-bool Parser::collapseParentheses(Term *term) {
-    if (term == NULL) return false;
-    bool changed = false;
-
-    switch (term->type) {
-        case APPLICATION:
-            if (term->rTerm == NULL && term->lTerm->type == APPLICATION &&
-                term->lTerm->rTerm == NULL) {
-                Term *oldTerm = term->lTerm;
-                term->lTerm = oldTerm->lTerm;
-                delete oldTerm;
-
-                changed = true;
-            } else if (term->rTerm != NULL &&
-                       term->lTerm->type == APPLICATION &&
-                       term->lTerm->rTerm == NULL) {
-                Term *oldTerm = term->lTerm;
-                term->lTerm = oldTerm->lTerm;
-                delete oldTerm;
-
-                changed = true;
-            } else if (term->lTerm->type == APPLICATION &&
-                       term->lTerm->lTerm->type == PRIMARY) {
-                Term *oldTerm = term->lTerm->lTerm;
-                term->lTerm->type = oldTerm->type;
-                term->lTerm->var = oldTerm->var;
-                term->lTerm->lTerm = oldTerm->lTerm;
-                delete oldTerm;
-
-                changed = true;
-            }
-
-            changed |= collapseParentheses(term->lTerm);
-            changed |= collapseParentheses(term->rTerm);
-            break;
-        case PRIMARY:
-            changed |= collapseParentheses(term->rTerm);
-            break;
-        case ABSTRACTION:
-            if (term->lTerm->type == APPLICATION &&
-                term->lTerm->rTerm == NULL) {
-                Term *oldTerm = term->lTerm->lTerm;
-                term->lTerm->type = oldTerm->type;
-                term->lTerm->var = oldTerm->var;
-                term->lTerm->lTerm = oldTerm->lTerm;
-                term->lTerm->rTerm = oldTerm->rTerm;
-                delete oldTerm;
-
-                changed = true;
-            } else if (term->lTerm->type == APPLICATION &&
-                       term->lTerm->lTerm->type == PRIMARY) {
-                Term *oldTerm = term->lTerm->lTerm;
-                term->lTerm->type = oldTerm->type;
-                term->lTerm->var = oldTerm->var;
-                term->lTerm->lTerm = oldTerm->lTerm;
-                delete oldTerm;
-
-                changed = true;
-            }
-
-            changed |= collapseParentheses(term->lTerm);
-            break;
-    }
-
-    return changed;
-}
-
-void Parser::getFreeVars(Term *term, map<string, bool> &freeVars) {
-    if (term == NULL) return;
-    map<string, bool> freeVarsCopy;
-
-    switch (term->type) {
-        case ABSTRACTION:
-            freeVarsCopy = freeVars;
-            freeVarsCopy[term->var] = false;
-            getFreeVars(term->lTerm, freeVarsCopy);
-
-            for (auto i = freeVarsCopy.begin(); i != freeVarsCopy.end(); i++)
-                if (i->second) freeVars[i->first] = true;
-            break;
-        case APPLICATION:
-            getFreeVars(term->lTerm, freeVars);
-            getFreeVars(term->rTerm, freeVars);
-            break;
-        case PRIMARY:
-            if (freeVars.find(term->var) == freeVars.end())
-                freeVars[term->var] = true;
-            break;
-    }
-}
-
-void Parser::alphaRename(Term *term, const map<string, bool> &freeVars,
-                         map<string, string> &renames) {
-    if (term == NULL) return;
-    map<string, string> renamesCopy;
-    string renamedVar;
-
-    switch (term->type) {
-        case ABSTRACTION:
-            if (freeVars.find(term->var) == freeVars.end()) {
-                alphaRename(term->lTerm, freeVars, renames);
-            } else {
-                renamedVar = nextRenamedVar();
-                renamesCopy = renames;
-                renamesCopy[term->var] = renamedVar;
-                term->var = renamedVar;
-                alphaRename(term->lTerm, freeVars, renamesCopy);
-            }
-            break;
-        case APPLICATION:
-            alphaRename(term->lTerm, freeVars, renames);
-            alphaRename(term->rTerm, freeVars, renames);
-            break;
-        case PRIMARY:
-            if (renames.find(term->var) != renames.end())
-                term->var = renames[term->var];
-            break;
-    }
-    return;
-}
-
-bool Parser::substituteDefs(Term *term) {
-    if (term == NULL) return false;
-    bool changed = false;
-
-    if (term->type == ABSTRACTION)
-        changed = substituteDefs(term->lTerm);
-    else if (term->type == APPLICATION) {
-        changed = substituteDefs(term->lTerm);
-        changed |= substituteDefs(term->rTerm);
-    } else if (term->type == PRIMARY) {
-        if (definitions.find(term->var) != definitions.end()) {
-            term->type = APPLICATION;
-            term->lTerm = copyTerm(definitions[term->var]);
-            term->var = "";
-            changed = true;
-        }
-
-        changed |= substituteDefs(term->rTerm);
-    }
-
-    return changed;
-}
-
-void Parser::substituteVars(Term *term, string var, Term *termToSub) {
-    if (term == NULL) return;
-
-    if (term->type == ABSTRACTION) {
-        if (term->var.compare(var) != 0) {
-            substituteVars(term->lTerm, var, termToSub);
-        }
-    } else if (term->type == APPLICATION) {
-        substituteVars(term->lTerm, var, termToSub);
-
-        if (term->rTerm != NULL) {
-            substituteVars(term->rTerm, var, termToSub);
-        }
-    } else if (term->type == PRIMARY) {
-        if (term->var.compare(var) == 0) {
-            term->type = APPLICATION;
-            term->lTerm = copyTerm(termToSub);
-        }
-
-        if (term->rTerm != NULL) {
-            substituteVars(term->rTerm, var, termToSub);
-        }
-    }
-}
-
-string Parser::nextRenamedVar() { return "a" + to_string(renameCount++); }
-
-Term *Parser::copyTerm(Term *term) {
-    if (term == NULL) return NULL;
-
-    Term *newTerm = new Term;
-    newTerm->type = term->type;
-    newTerm->var = term->var;
-    newTerm->lTerm = copyTerm(term->lTerm);
-    newTerm->rTerm = copyTerm(term->rTerm);
-
-    return newTerm;
-}
-
-string Parser::termToString(Term *term) {
-    if (term == NULL) return "";
-
-    switch (term->type) {
-        case ABSTRACTION:
-            return ("!" + term->var + "." + termToString(term->lTerm));
-        case APPLICATION:
-            return ("(" + termToString(term->lTerm) + ")" +
-                    termToString(term->rTerm));
-        case PRIMARY:
-            string res = term->var;
-            if (term->rTerm != NULL) res += " " + termToString(term->rTerm);
-            return res;
-            break;
-    }
-
-    runtimeError("Unable to convert term to string");
-}
-
-bool Parser::termToBool(Term *term) {
-    if (term == NULL) runtimeError("Unable to convert term to bool");
-
-    if (term->type == PRIMARY)
-        runtimeError("A primary cannot be a bool");
-    else if (term->type == APPLICATION) {
-        if (term->lTerm->type != ABSTRACTION || term->rTerm != NULL)
-            runtimeError("Unable to convert term to bool");
-
-        term = term->lTerm;
-    }
-
-    if (term->lTerm->type != ABSTRACTION ||
-        term->lTerm->lTerm->type != PRIMARY ||
-        term->lTerm->lTerm->rTerm != NULL) {
-        runtimeError("Unable to convert term to bool");
-    }
-
-    Term *outerAbs = term;
-    Term *innerAbs = term->lTerm;
-    Term *primary = term->lTerm->lTerm;
-    string varA = outerAbs->var;
-    string varB = innerAbs->var;
-    string varC = primary->var;
-
-    if (varA.compare(varC) == 0)
-        return true;
-    else if (varB.compare(varC) == 0)
-        return false;
-
-    runtimeError("Unable to convert term to bool");
-}
-
-int Parser::termToNum(Term *term) {
-    if (term == NULL) runtimeError("Unable to convert term to number");
-
-    if (term->type == PRIMARY)
-        runtimeError("A primary cannot be a number");
-    else if (term->type == APPLICATION) {
-        if (term->lTerm->type != ABSTRACTION || term->rTerm != NULL)
-            runtimeError("Unable to convert term to number");
-
-        term = term->lTerm;
-    }
-
-    if (term->lTerm->type != ABSTRACTION || term->lTerm->lTerm->type != PRIMARY)
-        runtimeError("Unable to convert term to number");
-
-    int num = 0;
-    Term *outerAbs = term;
-    Term *innerAbs = outerAbs->lTerm;
-    Term *primary = innerAbs->lTerm;
-    term = primary;
-
-    if (outerAbs->var.compare(innerAbs->var) == 0)
-        runtimeError("Unable to convert term to number");
-
-    while (term->var.compare(outerAbs->var) == 0) {
-        num++;
-        term = term->rTerm;
-
-        if (term == NULL) runtimeError("Unable to convert term to number");
-
-        switch (term->type) {
-            case PRIMARY:
-                if (term->var.compare(innerAbs->var) != 0)
-                    runtimeError("Unable to convert term to number");
-                break;
-            case APPLICATION:
-                if (term->rTerm != NULL)
-                    runtimeError("Unable to convert term to number");
-
-                term = term->lTerm;
-
-                if (term->type != PRIMARY)
-                    runtimeError("Unable to convert term to number");
-                break;
-            case ABSTRACTION:
-                runtimeError("Unable to convert term to number");
-                break;
-        }
-    }
-
-    if (term->var.compare(innerAbs->var) != 0 || term->rTerm != NULL)
-        runtimeError("Unable to convert term to number");
-
-    return num;
-}
-
-Term *Parser::numToTerm(int num) {
-    Term *outerAbs = new Term;
-    Term *innerAbs = new Term;
-    Term *basePrimary = new Term;
-
-    outerAbs->type = ABSTRACTION;
-    outerAbs->var = nextRenamedVar();
-    outerAbs->lTerm = innerAbs;
-    outerAbs->rTerm = NULL;
-
-    innerAbs->type = ABSTRACTION;
-    innerAbs->var = nextRenamedVar();
-    innerAbs->lTerm = basePrimary;
-    innerAbs->rTerm = NULL;
-
-    basePrimary->type = PRIMARY;
-    basePrimary->var = innerAbs->var;
-    basePrimary->lTerm = NULL;
-    basePrimary->rTerm = NULL;
-
-    while (num > 0) {
-        Term *term = new Term;
-        term->type = APPLICATION;
-        term->var = "";
-        term->lTerm = innerAbs->lTerm;
-        term->rTerm = NULL;
-
-        Term *primary = new Term;
-        primary->type = PRIMARY;
-        primary->var = outerAbs->var;
-        primary->lTerm = NULL;
-        primary->rTerm = term;
-
-        innerAbs->lTerm = primary;
-        num--;
-    }
-
-    return outerAbs;
+
+#include "parser.hh"
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "libraries.hh"
+#include "pool.hh"
+#include "reducer.hh"
+#include "stats.hh"
+
+using namespace std;
+
+void Parser::importError(string msg) {
+    cout << "IMPORT ERROR: " << msg << "\n";
+    exit(1);
+}
+
+void Parser::syntaxError(int lineNum, string msg) {
+    cout << "SYNTAX ERROR (" << lineNum << "): " << msg << "\n";
+    exit(1);
+}
+
+void Parser::expect(TokenType type, const char *msg) {
+    Token t = lexer->GetToken();
+    if (t.tokenType != type) syntaxError(t.lineNum, msg);
+}
+
+void Parser::checkType(Token token, TokenType type, const char *msg) {
+    if (token.tokenType != type) syntaxError(token.lineNum, msg);
+}
+
+void Parser::EnableHashConsing() { store.EnableHashConsing(); }
+
+void Parser::SetEngine(EngineType engineType) {
+    engine = engineType;
+    engineChosen = true;
+}
+
+void Parser::SetStrategy(Strategy runStrategy) { strategy = runStrategy; }
+
+void Parser::ShowSteps() { showSteps = true; }
+
+void Parser::ShowStats(StatsFormat format) { statsFormat = format; }
+
+void Parser::ShowBytecode() { showBytecode = true; }
+
+void Parser::SetJobs(int jobCount) { jobs = jobCount; }
+
+void Parser::SetParallel(int threadCount, size_t sizeCutoff) {
+    threads = threadCount;
+    cutoff = sizeCutoff;
+}
+
+void Parser::NormalizeDefinitions(uint64_t stepLimit) {
+    defStepLimit = stepLimit;
+}
+
+void Parser::DetectDivergence(size_t growthLimit) {
+    store.EnableShapeHashing();
+    detectDivergence = true;
+    liveLimit = growthLimit;
+}
+
+void Parser::StreamStatements() { streaming = true; }
+
+bool Parser::OpenFile(string filename) {
+    return lexer->OpenFile(filename, streaming);
+}
+
+void Parser::ParseInput() {
+    uint64_t bytes = AllocatedBytes();
+    double start = Now();
+
+    parseProgram();
+    if (defStepLimit > 0) normalizeDefinitions();
+    if (engine == ENGINE_VM || showBytecode) compile();
+
+    parseStats.parseTime = Now() - start;
+    parseStats.bytesAllocated = AllocatedBytes() - bytes;
+    parseStats.liveTerms = store.Size();
+    parseStats.peakTerms = store.Peak();
+}
+
+void Parser::ReduceAndPrint() {
+    statementStats.assign(statements.size(), Stats());
+
+    if (jobs > 1 && statements.size() > 1) {
+        reduceInParallel();
+        printStats();
+        out.Flush();
+        return;
+    }
+
+    Reducer reducer(store, symbols, definitions, program, names, engine);
+    unique_ptr<WorkPool> pool;
+    if (detectDivergence) reducer.DetectDivergence(liveLimit);
+
+    if (threads > 1) {
+        pool.reset(new WorkPool(threads));
+        reducer.SetParallel(pool.get(), cutoff);
+    }
+
+    if (streaming) {
+        reduceStream(reducer);
+    } else {
+        for (size_t i = 0; i < statements.size(); i++) {
+            size_t mark = store.Mark();
+
+            reducer.Reduce(statements[i], i, out);
+            out.Put('\n');
+            endStatement(report(i, reducer));
+
+            store.Release(mark);
+        }
+    }
+
+    printStats();
+    out.Flush();
+}
+
+// Parses, reduces and prints one statement at a time, and drops its terms,
+// numerals, names, code and text before reading the next, so that a stream
+// of any length runs in the memory of its largest statement. Each result is
+// flushed as soon as it is written.
+void Parser::reduceStream(Reducer &reducer) {
+    bool compiled = engine == ENGINE_VM || showBytecode;
+    size_t i = 0;
+
+    do {
+        size_t mark = store.Mark();
+        size_t numerals = store.NumeralMark();
+        size_t interned = symbols.Size();
+        double start = Now();
+
+        parseReduction();
+        Statement statement = statements.back();
+        statements.pop_back();
+
+        if (compiled) {
+            statement.entry = program.Compile(
+                statement.term, "statement " + to_string(i + 1));
+            if (showBytecode) program.Disassemble(statement.entry);
+        }
+
+        parseStats.parseTime += Now() - start;
+        if (statsFormat != STATS_NONE) statementStats.push_back(Stats());
+
+        reducer.Reduce(statement, i, out);
+        out.Put('\n');
+        endStatement(report(i, reducer));
+        out.Flush();
+
+        store.Release(mark);
+        store.ReleaseNumerals(numerals);
+        symbols.Truncate(interned);
+        if (compiled) program.Truncate(statement.entry);
+        lexer->Release();
+        i++;
+    } while (lexer->Peek().tokenType != END_OF_FILE);
+}
+
+// Statements are handed out to the workers one at a time, and the main
+// thread writes their output in order as it comes in. Each worker reduces
+// into its own fork of the store, which the parsed terms are only read from.
+void Parser::reduceInParallel() {
+    OutputQueue output(statements.size());
+    atomic<size_t> next(0);
+    vector<thread> workers;
+
+    for (int i = 0; i < jobs; i++)
+        workers.emplace_back(&Parser::reduceStatements, this, ref(output),
+                             ref(next));
+
+    output.WriteAll(out);
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+}
+
+void Parser::reduceStatements(OutputQueue &output, atomic<size_t> &next) {
+    TermStore fork(store);
+    Reducer reducer(fork, symbols, definitions, program, names, engine,
+                    &output);
+    unique_ptr<WorkPool> pool;
+    if (detectDivergence) reducer.DetectDivergence(liveLimit);
+
+    if (threads > 1) {
+        pool.reset(new WorkPool(threads));
+        reducer.SetParallel(pool.get(), cutoff);
+    }
+
+    string text;
+    Output result(&text);
+
+    for (size_t i = next++; i < statements.size(); i = next++) {
+        size_t mark = fork.Mark();
+
+        reducer.Reduce(statements[i], i, result);
+        result.Put('\n');
+        result.Drain();
+
+        output.Put(i, text, report(i, reducer));
+        fork.Release(mark);
+    }
+}
+
+// Records what a statement cost and returns the lines --steps and --stats
+// write for it. A stream keeps the costs only when they are to be shown.
+string Parser::report(size_t statement, Reducer &reducer) {
+    string res;
+    if (statement < statementStats.size())
+        statementStats[statement] = reducer.Statistics();
+
+    if (showSteps) res += to_string(reducer.BetaSteps()) + " beta steps\n";
+
+    if (statsFormat == STATS_TEXT)
+        res += "statement " + to_string(statement + 1) + ": " +
+               reducer.Statistics().ToString() + "\n";
+
+    return res;
+}
+
+// Hands the result just written on, and flushes it before writing what
+// --steps and --stats report for it, so that the two stay in order when
+// they go to the same place.
+void Parser::endStatement(const string &err) {
+    if (err.empty()) {
+        out.Drain();
+        return;
+    }
+
+    out.Flush();
+    cerr << err;
+}
+
+void Parser::printStats() {
+    if (statsFormat == STATS_NONE) return;
+    out.Flush();
+
+    Stats total = parseStats;
+    for (size_t i = 0; i < statementStats.size(); i++)
+        total.Add(statementStats[i]);
+    total.liveTerms = store.Size();
+
+    if (statsFormat == STATS_TEXT) {
+        cerr << "total: " << total.ToString() << endl;
+        return;
+    }
+
+    cerr << "{\"parse\": " << parseStats.ToJson() << ", \"statements\": [";
+
+    for (size_t i = 0; i < statementStats.size(); i++)
+        cerr << (i > 0 ? ", " : "") << statementStats[i].ToJson();
+
+    cerr << "], \"total\": " << total.ToJson() << "}" << endl;
+}
+
+void Parser::parseProgram() {
+    Token t = lexer->Peek();
+    if (t.tokenType == LET || t.tokenType == IMPORT) parseDefList();
+    if (streaming) return;
+
+    parseReductionList();
+    expect(END_OF_FILE, "Expected end of file");
+}
+
+void Parser::parseDefList() {
+    Token t = lexer->Peek();
+
+    while (t.tokenType == LET || t.tokenType == IMPORT) {
+        parseDef();
+        t = lexer->Peek();
+    }
+}
+
+void Parser::parseDef() {
+    Token t = lexer->Peek();
+
+    if (t.tokenType == IMPORT) {
+        parseImport();
+    } else {
+        expect(LET, "Expected 'let'");
+
+        Token t = lexer->GetToken();
+        checkType(t, ID, "Expected definition name");
+        Symbol var = symbols.Intern(t.lexeme);
+
+        expect(EQUAL, "Expected '='");
+
+        TermId term = parseTerm();
+        definitions.Set(var, term);
+        if (module != NULL)
+            module->push_back({ENTRY_LET, string(t.lexeme), term});
+
+        expect(SEMICOLON, "Expected semicolon");
+    }
+}
+
+void Parser::parseImport() {
+    string importName;
+    bool isFile;
+
+    expect(IMPORT, "Expected 'import'");
+
+    Token id = lexer->GetToken();
+    checkType(id, ID, "Expected import name");
+
+    Token t = lexer->Peek();
+    if (t.tokenType == DOT) {
+        lexer->UngetToken(id);
+        importName = parseFilename();
+        isFile = true;
+    } else {
+        importName = string(id.lexeme);
+        isFile = false;
+    }
+
+    expect(SEMICOLON, "Expected semicolon");
+
+    if (module != NULL)
+        module->push_back(
+            {isFile ? ENTRY_IMPORT : ENTRY_LIBRARY, importName, NIL_TERM});
+
+    if (isFile)
+        importFile(importName);
+    else
+        importLibrary(importName);
+}
+
+// A module file is parsed once per run, and only if its cache does not
+// stand for it any more, in which case the cache is made again.
+void Parser::importFile(string filename) {
+    if (imported[filename]) return;
+    imported[filename] = true;
+
+    vector<ModuleEntry> entries;
+
+    if (modules.Load(filename, entries)) {
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].type == ENTRY_LET)
+                definitions.Set(symbols.Intern(entries[i].name),
+                                entries[i].term);
+            else if (entries[i].type == ENTRY_IMPORT)
+                importFile(entries[i].name);
+            else
+                importLibrary(entries[i].name);
+        }
+        return;
+    }
+
+    Lexer moduleLexer;
+    if (!moduleLexer.OpenFile(filename))
+        importError(filename + " not found in local directory");
+
+    parseModule(moduleLexer, &entries);
+    modules.Save(filename, entries);
+}
+
+void Parser::importLibrary(string name) {
+    if (LIBRARIES.find(name) == LIBRARIES.end())
+        importError(name + " is not a native library");
+
+    Lexer moduleLexer;
+    moduleLexer.UnshiftString(LIBRARIES.at(name));
+    parseModule(moduleLexer, NULL);
+}
+
+// Parses the definitions and imports of a module with its own lexer,
+// recording them in entries if it is to be cached.
+void Parser::parseModule(Lexer &moduleLexer, vector<ModuleEntry> *entries) {
+    Lexer *outerLexer = lexer;
+    vector<ModuleEntry> *outerModule = module;
+    lexer = &moduleLexer;
+    module = entries;
+
+    parseDefList();
+    expect(END_OF_FILE, "Expected 'let' or 'import'");
+
+    lexer = outerLexer;
+    module = outerModule;
+}
+
+string Parser::parseFilename() {
+    Token id = lexer->GetToken();
+    checkType(id, ID, "Expected import file name");
+
+    expect(DOT, "Expected '.");
+
+    Token ext = lexer->GetToken();
+    checkType(ext, HEADER_EXTENSION, "Expected header extension");
+
+    return string(id.lexeme) + "." + string(ext.lexeme);
+}
+
+void Parser::parseReductionList() {
+    Token t = lexer->Peek();
+
+    do {
+        parseReduction();
+        t = lexer->Peek();
+    } while (t.tokenType != END_OF_FILE);
+}
+
+void Parser::parseReduction() {
+    PrintType printType = parsePrint();
+    Strategy statementStrategy = parseStrategy(printType);
+    TermId term = parseTerm();
+    statements.push_back({term, printType, statementStrategy, 0});
+
+    expect(SEMICOLON, "Expected semicolon");
+}
+
+PrintType Parser::parsePrint() {
+    Token t = lexer->GetToken();
+    checkType(t, PRINT, "Expected print type");
+
+    if (t.lexeme == "print")
+        return PRINT_FUNC;
+    else if (t.lexeme == "printnum")
+        return PRINT_NUM;
+    else if (t.lexeme != "printbool")
+        syntaxError(t.lineNum, "Invalid print type");
+
+    return PRINT_BOOL;
+}
+
+// Parses the optional [strategy] after a print keyword. Without one, a
+// statement uses the strategy of the run, or else the engine chosen for the
+// run. If neither was chosen, numbers and booleans are read off a weak head
+// normal form, which call-by-need reaches at the least cost of the
+// strategies that find a normal form whenever there is one. The divergence
+// detector only watches normal order, so with it every statement keeps to
+// the substitution engine.
+Strategy Parser::parseStrategy(PrintType printType) {
+    Token t = lexer->Peek();
+
+    if (t.tokenType == LBRACKET) {
+        Strategy named;
+        expect(LBRACKET, "Expected '['");
+
+        Token name = lexer->GetToken();
+        checkType(name, ID, "Expected strategy name");
+        if (!FindStrategy(string(name.lexeme), named))
+            syntaxError(name.lineNum,
+                        "Unknown strategy " + string(name.lexeme));
+        if (detectDivergence && named != STRATEGY_NORMAL)
+            syntaxError(name.lineNum,
+                        "--detect-divergence only watches the normal strategy");
+
+        expect(RBRACKET, "Expected ']'");
+        return named;
+    }
+
+    if (strategy != STRATEGY_DEFAULT) return strategy;
+    if (!engineChosen && !detectDivergence && printType != PRINT_FUNC)
+        return STRATEGY_CBNEED;
+    return STRATEGY_DEFAULT;
+}
+
+// Parses a sequence of terms applied left to right. Parentheses and
+// abstractions open a nested sequence; instead of recursing, the sequence
+// built so far is saved in a frame and resumed once the nested one ends.
+TermId Parser::parseTerm() {
+    vector<ParseFrame> frames;
+    TermId term = NIL_TERM;
+
+    while (true) {
+        Token t = lexer->Peek();
+        TermId arg = NIL_TERM;
+
+        switch (t.tokenType) {
+            case RPAREN:
+            case SEMICOLON:
+            case END_OF_FILE:
+                if (term == NIL_TERM)
+                    syntaxError(t.lineNum, "Unable to parse term");
+
+                if (frames.empty()) return term;
+
+                if (frames.back().opener == LAMBDA) {
+                    arg = store.Make(ABSTRACTION, frames.back().var, term,
+                                     NIL_TERM);
+                    boundVars.pop_back();
+                } else {
+                    expect(RPAREN, "Expected ')'");
+                    arg = term;
+                }
+
+                term = frames.back().term;
+                frames.pop_back();
+                break;
+            case LAMBDA:
+                expect(LAMBDA, "Expected '!'");
+
+                t = lexer->GetToken();
+                checkType(t, ID, "Expected variable name");
+
+                expect(DOT, "Expected '.'");
+
+                frames.push_back({LAMBDA, term, symbols.Intern(t.lexeme)});
+                boundVars.push_back(frames.back().var);
+                term = NIL_TERM;
+                continue;
+            case LPAREN:
+                expect(LPAREN, "Expected '('");
+                frames.push_back({LPAREN, term, 0});
+                term = NIL_TERM;
+                continue;
+            case ID:
+                arg = parseVariable();
+                break;
+            case NUM:
+                arg = store.MakeNumeral(
+                    Natural(string(parsePrimary().lexeme)));
+                break;
+            default:
+                syntaxError(t.lineNum, "Unable to parse term");
+        }
+
+        if (term == NIL_TERM)
+            term = arg;
+        else
+            term = store.Make(APPLICATION, 0, term, arg);
+    }
+}
+
+TermId Parser::parseVariable() {
+    Symbol var = symbols.Intern(parsePrimary().lexeme);
+
+    for (int i = boundVars.size() - 1; i >= 0; i--) {
+        if (boundVars[i] == var)
+            return store.Make(INDEX, boundVars.size() - 1 - i, NIL_TERM,
+                             NIL_TERM);
+    }
+
+    return store.Make(PRIMARY, var, NIL_TERM, NIL_TERM);
+}
+
+Token Parser::parsePrimary() {
+    Token t = lexer->GetToken();
+    if (t.tokenType != ID && t.tokenType != NUM)
+        syntaxError(t.lineNum, "Primary must be alphanumeric");
+    return t;
+}
+
+void Parser::parseComment() {}
+
+// Reduces every definition to normal form once, after the definitions it
+// uses, so each is built from normal forms already found and no statement
+// has to derive them again. A definition that takes more than defStepLimit
+// beta steps, such as one that never reaches a normal form, keeps its body
+// as written.
+void Parser::normalizeDefinitions() {
+    Reducer reducer(store, symbols, definitions, program, names,
+                    ENGINE_SUBST);
+    const vector<Symbol> &defined = definitions.Names();
+    vector<pair<Symbol, bool>> pending;
+    map<Symbol, bool> seen;
+    vector<Symbol> order;
+
+    for (size_t i = defined.size(); i > 0; i--)
+        pending.push_back({defined[i - 1], false});
+
+    while (!pending.empty()) {
+        Symbol name = pending.back().first;
+        bool expanded = pending.back().second;
+        pending.pop_back();
+
+        if (expanded) {
+            order.push_back(name);
+            continue;
+        }
+
+        if (seen[name]) continue;
+        seen[name] = true;
+        pending.push_back({name, true});
+
+        vector<Symbol> uses;
+        findUses(definitions.Find(name), uses);
+
+        for (size_t i = 0; i < uses.size(); i++)
+            if (!seen[uses[i]]) pending.push_back({uses[i], false});
+    }
+
+    for (size_t i = 0; i < order.size(); i++) {
+        TermId normal = reducer.NormalizeDefinition(
+            definitions.Find(order[i]), defStepLimit);
+        if (normal != NIL_TERM) definitions.Set(order[i], normal);
+    }
+
+    parseStats.Add(reducer.Statistics());
+}
+
+// Lists the definitions term refers to.
+void Parser::findUses(TermId term, vector<Symbol> &uses) {
+    vector<TermId> pending;
+    pending.push_back(term);
+
+    while (!pending.empty()) {
+        Term t = store[pending.back()];
+        pending.pop_back();
+
+        if (t.type == PRIMARY && definitions.Find(t.var) != NIL_TERM)
+            uses.push_back(t.var);
+
+        if (t.type == ABSTRACTION || t.type == APPLICATION)
+            pending.push_back(t.lTerm);
+        if (t.type == APPLICATION) pending.push_back(t.rTerm);
+    }
+}
+
+void Parser::compile() {
+    program.CompileDefinitions(definitions);
+
+    for (size_t i = 0; i < statements.size(); i++)
+        statements[i].entry =
+            program.Compile(statements[i].term, "statement " + to_string(i + 1));
+
+    if (showBytecode) program.Disassemble();
 }
\ No newline at end of file
@@ -1,67 +1,108 @@
-#ifndef __PARSER_H__
-#define __PARSER_H__
-
-#include <map>
-#include <string>
-#include <vector>
-
-#include "lexer.hh"
-
-using namespace std;
-
-typedef enum { ABSTRACTION = 0, APPLICATION, PRIMARY } TermType;
-typedef enum { PRINT_FUNC = 0, PRINT_NUM, PRINT_BOOL } PrintType;
-
-struct Term {
-    TermType type;
-    string var;
-    Term *lTerm;
-    Term *rTerm;
-};
-
-class Parser {
-   public:
-    bool OpenFile(string filename);
-    void ParseInput();
-    void ReduceAndPrint();
-
-   private:
-    Lexer lexer;
-    map<string, Term *> definitions;
-    vector<Term *> reductions;
-    vector<PrintType> printTypes;
-    int renameCount = 0;
-
-    void importError(string msg);
-    void syntaxError(int lineNum, string msg);
-    void runtimeError(string msg);
-    void expect(TokenType type, string msg);
-    void checkType(Token token, TokenType type, string msg);
-    void parseProgram();
-    void parseImportList();
-    void parseImport();
-    string parseFilename();
-    void parseDefList();
-    void parseDef();
-    void parseReductionList();
-    void parseReduction();
-    PrintType parsePrint();
-    Term *parseTerm();
-    string parsePrimary();
-    void parseComment();
-    bool betaReduce(Term *term);
-    bool collapseParentheses(Term *term);
-    void getFreeVars(Term *term, map<string, bool> &freeVars);
-    void alphaRename(Term *term, const map<string, bool> &freeVars,
-                     map<string, string> &renames);
-    bool substituteDefs(Term *term);
-    void substituteVars(Term *term, string var, Term *termToSub);
-    string nextRenamedVar();
-    Term *copyTerm(Term *term);
-    string termToString(Term *term);
-    bool termToBool(Term *term);
-    int termToNum(Term *term);
-    Term *numToTerm(int num);
-};
-
-#endif
+#ifndef __PARSER_H__
+#define __PARSER_H__
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bytecode.hh"
+#include "definitions.hh"
+#include "lexer.hh"
+#include "module.hh"
+#include "natural.hh"
+#include "output.hh"
+#include "reducer.hh"
+#include "stats.hh"
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+struct ParseFrame {
+    TokenType opener;
+    TermId term;
+    Symbol var;
+};
+
+class Parser {
+   public:
+    void EnableHashConsing();
+    void SetEngine(EngineType engineType);
+    void SetStrategy(Strategy runStrategy);
+    void ShowSteps();
+    void ShowStats(StatsFormat format);
+    void ShowBytecode();
+    void SetJobs(int jobCount);
+    void SetParallel(int threadCount, size_t sizeCutoff);
+    void NormalizeDefinitions(uint64_t stepLimit);
+    void DetectDivergence(size_t growthLimit);
+    void StreamStatements();
+    bool OpenFile(string filename);
+    void ParseInput();
+    void ReduceAndPrint();
+
+   private:
+    Lexer source;
+    Lexer *lexer = &source;
+    SymbolTable symbols;
+    TermStore store;
+    Definitions definitions;
+    vector<Statement> statements;
+    Output out;
+    vector<Symbol> boundVars;
+    NumeralNames names{symbols.Intern("f"), symbols.Intern("x")};
+    Bytecode program{store, symbols, names};
+    ModuleCache modules{store, symbols};
+    map<string, bool> imported;
+    vector<ModuleEntry> *module = NULL;
+    EngineType engine = ENGINE_SUBST;
+    bool engineChosen = false;
+    Strategy strategy = STRATEGY_DEFAULT;
+    bool showSteps = false;
+    StatsFormat statsFormat = STATS_NONE;
+    Stats parseStats;
+    vector<Stats> statementStats;
+    bool showBytecode = false;
+    int jobs = 1;
+    int threads = 1;
+    size_t cutoff = 1024;
+    uint64_t defStepLimit = 0;
+    bool detectDivergence = false;
+    size_t liveLimit = 0;
+    bool streaming = false;
+
+    void importError(string msg);
+    void syntaxError(int lineNum, string msg);
+    void expect(TokenType type, const char *msg);
+    void checkType(Token token, TokenType type, const char *msg);
+    void parseProgram();
+    void parseImportList();
+    void parseImport();
+    string parseFilename();
+    void importFile(string filename);
+    void importLibrary(string name);
+    void parseModule(Lexer &moduleLexer, vector<ModuleEntry> *entries);
+    void parseDefList();
+    void parseDef();
+    void parseReductionList();
+    void parseReduction();
+    PrintType parsePrint();
+    Strategy parseStrategy(PrintType printType);
+    TermId parseTerm();
+    TermId parseVariable();
+    Token parsePrimary();
+    void parseComment();
+    void normalizeDefinitions();
+    void findUses(TermId term, vector<Symbol> &uses);
+    void compile();
+    void reduceStream(Reducer &reducer);
+    void reduceInParallel();
+    void reduceStatements(OutputQueue &output, atomic<size_t> &next);
+    string report(size_t statement, Reducer &reducer);
+    void endStatement(const string &err);
+    void printStats();
+};
+
+#endif
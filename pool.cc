@@ -0,0 +1,125 @@
+#include "pool.hh"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+thread_local WorkPool *currentPool = NULL;
+thread_local int currentWorker = 0;
+
+WorkPool::WorkPool(int threadCount) : pending(0), stopping(false) {
+    for (int i = 0; i < threadCount; i++)
+        queues.push_back(unique_ptr<TaskQueue>(new TaskQueue()));
+
+    currentPool = this;
+    currentWorker = 0;
+
+    for (int i = 1; i < threadCount; i++)
+        threads.emplace_back(&WorkPool::work, this, i);
+}
+
+WorkPool::~WorkPool() {
+    {
+        lock_guard<mutex> guard(idleLock);
+        stopping = true;
+    }
+
+    idle.notify_all();
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    if (currentPool == this) currentPool = NULL;
+}
+
+void WorkPool::Spawn(Task *task) {
+    TaskQueue &queue = *queues[self()];
+    {
+        lock_guard<mutex> guard(idleLock);
+        pending++;
+    }
+
+    {
+        lock_guard<mutex> guard(queue.lock);
+        queue.tasks.push_back(task);
+    }
+
+    idle.notify_one();
+}
+
+// Sleeps whenever there is nothing to run, until either the task is done
+// or another is spawned.
+void WorkPool::Wait(Task *task) {
+    int worker = self();
+
+    while (!task->done) {
+        Task *next = take(worker);
+
+        if (next != NULL) {
+            execute(next);
+            continue;
+        }
+
+        unique_lock<mutex> guard(idleLock);
+        idle.wait(guard, [&] { return task->done || pending > 0; });
+    }
+}
+
+size_t WorkPool::Size() { return queues.size(); }
+
+int WorkPool::self() { return currentPool == this ? currentWorker : 0; }
+
+Task *WorkPool::take(int worker) {
+    for (size_t i = 0; i < queues.size(); i++) {
+        TaskQueue &queue = *queues[(worker + i) % queues.size()];
+        lock_guard<mutex> guard(queue.lock);
+        if (queue.tasks.empty()) continue;
+
+        Task *task;
+        if (i == 0) {
+            task = queue.tasks.back();
+            queue.tasks.pop_back();
+        } else {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+        }
+
+        pending--;
+        return task;
+    }
+
+    return NULL;
+}
+
+void WorkPool::execute(Task *task) {
+    task->run();
+
+    {
+        lock_guard<mutex> guard(idleLock);
+        task->done = true;
+    }
+
+    idle.notify_all();
+}
+
+void WorkPool::work(int worker) {
+    currentPool = this;
+    currentWorker = worker;
+
+    while (true) {
+        Task *task = take(worker);
+
+        if (task != NULL) {
+            execute(task);
+            continue;
+        }
+
+        unique_lock<mutex> guard(idleLock);
+        idle.wait(guard, [&] { return stopping || pending > 0; });
+        if (stopping) return;
+    }
+}
\ No newline at end of file
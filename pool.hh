@@ -0,0 +1,53 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+struct Task {
+    function<void()> run;
+    atomic<bool> done{false};
+};
+
+struct TaskQueue {
+    mutex lock;
+    deque<Task *> tasks;
+};
+
+// A work-stealing thread pool. The thread that makes the pool takes part as
+// worker 0. Each worker pushes and pops spawned tasks at the back of its own
+// queue and, when that is empty, steals from the front of another's. A
+// thread waiting for a task runs other tasks in the meantime, so waits can
+// nest without blocking the pool, and sleeps on idle once there are none.
+// idle is signalled both when a task is spawned and when one is done.
+class WorkPool {
+   public:
+    WorkPool(int threadCount);
+    ~WorkPool();
+    void Spawn(Task *task);
+    void Wait(Task *task);
+    size_t Size();
+
+   private:
+    vector<unique_ptr<TaskQueue>> queues;
+    vector<thread> threads;
+    mutex idleLock;
+    condition_variable idle;
+    atomic<size_t> pending;
+    atomic<bool> stopping;
+
+    int self();
+    Task *take(int worker);
+    void execute(Task *task);
+    void work(int worker);
+};
+
+#endif
@@ -0,0 +1,879 @@
+#include "reducer.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "graph.hh"
+#include "krivine.hh"
+#include "optimal.hh"
+#include "output.hh"
+#include "pool.hh"
+#include "stats.hh"
+#include "vm.hh"
+
+using namespace std;
+
+OutputQueue::OutputQueue(size_t count)
+    : outs(count), errs(count), done(count, false) {
+    written = 0;
+}
+
+void OutputQueue::Put(size_t statement, string &out, string err) {
+    lock_guard<mutex> guard(lock);
+    outs[statement].swap(out);
+    errs[statement] = err;
+    done[statement] = true;
+    changed.notify_all();
+}
+
+// Blocks until the output of every statement before this one is written.
+void OutputQueue::WaitTurn(size_t statement) {
+    unique_lock<mutex> guard(lock);
+    changed.wait(guard, [&] { return written == statement; });
+}
+
+// Each output is handed on before the next statement's turn, so that an error
+// it reports comes after it, and flushed before anything is written to
+// standard error, so that the two stay in order when they go to one place.
+void OutputQueue::WriteAll(Output &out) {
+    unique_lock<mutex> guard(lock);
+
+    while (written < done.size()) {
+        changed.wait(guard, [&] { return done[written]; });
+
+        out.Write(outs[written]);
+
+        if (errs[written].empty()) {
+            out.Drain();
+        } else {
+            out.Flush();
+            cerr << errs[written];
+        }
+
+        outs[written] = string();
+        errs[written].clear();
+        written++;
+        changed.notify_all();
+    }
+}
+
+Reducer::Reducer(TermStore &store, SymbolTable &symbols,
+                 const Definitions &definitions, Bytecode &program,
+                 NumeralNames names, EngineType engine, OutputQueue *output)
+    : store(store),
+      symbols(symbols),
+      definitions(definitions),
+      names(names),
+      program(program),
+      engine(engine),
+      output(output) {}
+
+// Looks up a strategy by the name --strategy and print[...] use for it.
+bool FindStrategy(const string &name, Strategy &strategy) {
+    if (name == "normal")
+        strategy = STRATEGY_NORMAL;
+    else if (name == "cbv")
+        strategy = STRATEGY_CBV;
+    else if (name == "cbn")
+        strategy = STRATEGY_CBN;
+    else if (name == "cbneed")
+        strategy = STRATEGY_CBNEED;
+    else
+        return false;
+
+    return true;
+}
+
+// Errors are reported in statement order, after the output of every
+// statement before this one.
+void Reducer::runtimeError(string msg) {
+    if (output != NULL) output->WaitTurn(current);
+    cout << "RUNTIME ERROR: " << msg << "\n";
+    exit(1);
+}
+
+// With a pool, the substitution engine normalises the arguments of a
+// neutral application on separate threads once they are at least
+// sizeCutoff nodes.
+void Reducer::SetParallel(WorkPool *workPool, size_t sizeCutoff) {
+    pool = workPool;
+    cutoff = sizeCutoff;
+}
+
+// Watches the substitution engine for a reduction that cannot finish: one
+// that comes back to a term it has already reduced to, or one that keeps more
+// terms alive at every collection and more than growthLimit of them. Such a
+// statement prints why it diverges instead of a result. Off with a pool.
+void Reducer::DetectDivergence(size_t growthLimit) {
+    detect = true;
+    liveLimit = growthLimit;
+}
+
+// Writes the result into out, without the line break that ends it.
+void Reducer::Reduce(const Statement &statement, size_t index, Output &out) {
+    uint64_t bytes = AllocatedBytes();
+    double start = Now();
+
+    current = index;
+    stats = Stats();
+    divergence.clear();
+    store.ResetPeak();
+
+    TermId term = reduce(statement);
+    double reduced = Now();
+
+    if (!divergence.empty()) {
+        out.Write(divergence);
+    } else {
+        switch (statement.printType) {
+            case PRINT_FUNC:
+                printTerm(term, out);
+                break;
+            case PRINT_BOOL:
+                out.Write(termToBool(term) ? "true" : "false");
+                break;
+            case PRINT_NUM:
+                out.Write(termToNum(term).ToString());
+                break;
+        }
+    }
+
+    stats.reduceTime = reduced - start;
+    stats.printTime = Now() - reduced;
+    stats.liveTerms = store.Size();
+    stats.peakTerms = store.Peak();
+    stats.bytesAllocated = AllocatedBytes() - bytes;
+}
+
+// Normalises a definition body with the substitution engine, in a fork of
+// the store so that only the normal form is copied back. Gives up and
+// returns NIL_TERM once it has taken more than stepLimit beta steps.
+TermId Reducer::NormalizeDefinition(TermId term, uint64_t stepLimit) {
+    TermStore fork(store);
+    Reducer reducer(fork, symbols, definitions, program, names,
+                    ENGINE_SUBST);
+    reducer.stepLimit = stepLimit;
+
+    TermId normal = reducer.normalize(term);
+    stats.Add(reducer.stats);
+
+    if (normal == NIL_TERM) return NIL_TERM;
+    return adopt(fork, normal);
+}
+
+uint64_t Reducer::BetaSteps() { return stats.betaSteps; }
+
+const Stats &Reducer::Statistics() { return stats; }
+
+TermId Reducer::reduce(const Statement &statement) {
+    if (statement.strategy == STRATEGY_NORMAL) {
+        return normalize(statement.term);
+    } else if (statement.strategy != STRATEGY_DEFAULT) {
+        PassingMode passing = PASS_BY_NEED;
+        if (statement.strategy == STRATEGY_CBV) passing = PASS_BY_VALUE;
+        if (statement.strategy == STRATEGY_CBN) passing = PASS_BY_NAME;
+
+        KrivineMachine machine(store, definitions, names, passing);
+        TermId term = machine.Normalize(statement.term);
+        stats.Add(machine.Statistics());
+        return term;
+    } else if (engine == ENGINE_GRAPH) {
+        GraphReducer reducer(store, definitions, names);
+        TermId term = reducer.Normalize(statement.term);
+        stats.Add(reducer.Statistics());
+        return term;
+    } else if (engine == ENGINE_KRIVINE) {
+        KrivineMachine machine(store, definitions, names);
+        TermId term = machine.Normalize(statement.term);
+        stats.Add(machine.Statistics());
+        return term;
+    } else if (engine == ENGINE_OPTIMAL) {
+        OptimalReducer reducer(store, symbols, definitions, names, pool);
+        TermId term = reducer.Normalize(statement.term);
+        stats.Add(reducer.Statistics());
+        return term;
+    } else if (engine == ENGINE_VM) {
+        VirtualMachine vm(program, store);
+        TermId term = vm.Run(statement.entry);
+        stats.Add(vm.Statistics());
+        return term;
+    }
+
+    return normalize(statement.term);
+}
+
+// Reduces term to normal form in normal order. The focus only ever moves
+// down into the head of the term or back up one frame, so each redex is
+// found without rescanning the rest of the term. Frames record the path
+// from the root: an application waiting for its function to reach a head
+// (FRAME_APPLY), an argument being normalised after a neutral function
+// (FRAME_ARG), an abstraction whose body is being normalised (FRAME_ABS)
+// and an argument handed to another thread (FRAME_TASK). Past stepLimit
+// beta steps it gives up and returns NIL_TERM, as it does when the
+// divergence detector finds it cannot finish.
+//
+// Every term the reduction has made is garbage once nothing on the path
+// refers to it, so whenever the terms made since the start have doubled
+// since the last collection the store is compacted down to what the path
+// still reaches. This is skipped with a pool, whose tasks read the store.
+//
+// Reduction in normal order is deterministic, so once the whole term comes
+// back to a shape it had before it will never finish. The detector samples
+// that shape from the store's shape hashes every so many beta steps, at least
+// as many as there are frames so that sampling stays cheap on deep terms.
+TermId Reducer::normalize(TermId term) {
+    vector<Frame> frames;
+    DivergenceCheck check;
+    bool done = false;
+    size_t floor = store.Mark();
+    size_t collectAt = floor + COLLECT_MIN;
+
+    while (true) {
+        if (store.Mark() >= collectAt && pool == NULL) {
+            collect(term, frames, floor, check.term);
+            if (detect && outgrows(check, store.Mark() - floor))
+                return NIL_TERM;
+            collectAt = store.Mark() + max(store.Mark() - floor, COLLECT_MIN);
+        }
+
+        if (!done) {
+            Term t = store[term];
+
+            switch (t.type) {
+                case APPLICATION:
+                    frames.push_back({FRAME_APPLY, term, NIL_TERM});
+                    term = t.lTerm;
+                    break;
+                case ABSTRACTION:
+                    if (!frames.empty() && frames.back().type == FRAME_APPLY) {
+                        TermId arg = store[frames.back().node].rTerm;
+                        frames.pop_back();
+                        term = substituteVars(t.lTerm, 0, arg);
+                        if (++stats.betaSteps > stepLimit) return NIL_TERM;
+                        if (detect && pool == NULL &&
+                            stats.betaSteps >= check.nextSample &&
+                            repeats(check, term, frames))
+                            return NIL_TERM;
+                    } else {
+                        frames.push_back({FRAME_ABS, term, NIL_TERM});
+                        term = t.lTerm;
+                    }
+                    break;
+                case PRIMARY: {
+                    TermId definition = definitions.Find(t.var);
+
+                    if (definition != NIL_TERM) {
+                        term = definition;
+                        stats.unfoldings++;
+                    } else {
+                        done = true;
+                    }
+                    break;
+                }
+                case INDEX:
+                    done = true;
+                    break;
+                case NUMERAL:
+                    if (!frames.empty() && frames.back().type == FRAME_APPLY)
+                        term = store.Unfold(term, names.f, names.x);
+                    else
+                        done = true;
+                    break;
+            }
+
+            if (done && pool != NULL) spawnArguments(frames);
+            continue;
+        }
+
+        if (frames.empty()) {
+            tasks.clear();
+            return term;
+        }
+
+        Frame frame = frames.back();
+        frames.pop_back();
+        Term node = store[frame.node];
+
+        switch (frame.type) {
+            case FRAME_APPLY:
+                frames.push_back({FRAME_ARG, frame.node, term});
+                term = node.rTerm;
+                done = false;
+                break;
+            case FRAME_ARG:
+                if (frame.term != node.lTerm || term != node.rTerm)
+                    term = store.Make(APPLICATION, 0, frame.term, term);
+                else
+                    term = frame.node;
+                break;
+            case FRAME_ABS:
+                if (term != node.lTerm)
+                    term = store.Make(ABSTRACTION, node.var, term, NIL_TERM);
+                else
+                    term = frame.node;
+                break;
+            case FRAME_TASK:
+                frames.push_back({FRAME_ARG, frame.node, term});
+                term = joinArgument(frame.term);
+                break;
+        }
+    }
+}
+
+// Compacts the terms made since floor to those the focus, the frames and the
+// term saved by the divergence detector still refer to, and updates them to
+// the moved ids.
+void Reducer::collect(TermId &term, vector<Frame> &frames, size_t floor,
+                      TermId &saved) {
+    vector<TermId> roots;
+    roots.push_back(term);
+    roots.push_back(saved);
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        roots.push_back(frames[i].node);
+        roots.push_back(frames[i].term);
+    }
+
+    store.Compact(floor, roots);
+    stats.collections++;
+    term = roots[0];
+    saved = roots[1];
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].node = roots[2 * i + 2];
+        frames[i].term = roots[2 * i + 3];
+    }
+}
+
+// Samples the shape of the whole term being reduced, which is the focus and
+// what each frame on the path holds besides it.
+bool Reducer::repeats(DivergenceCheck &check, TermId term,
+                      const vector<Frame> &frames) {
+    uint64_t h = store.Shape(term);
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        h = MixHash(h, frames[i].type);
+        if (frames[i].type == FRAME_APPLY)
+            h = MixHash(h, store.Shape(store[frames[i].node].rTerm));
+        else if (frames[i].type == FRAME_ARG)
+            h = MixHash(h, store.Shape(frames[i].term));
+    }
+
+    check.nextSample =
+        stats.betaSteps + max(SAMPLE_MIN, (uint64_t)frames.size());
+
+    if (check.length == check.power) {
+        check.saved = h;
+        check.term = wholeTerm(term, frames);
+        check.power *= 2;
+        check.length = 0;
+    } else if (h == check.saved &&
+               sameTerm(wholeTerm(term, frames), check.term)) {
+        divergence = "diverges (cycle detected after " +
+                     to_string(stats.betaSteps) + " steps)";
+        return true;
+    }
+
+    check.length++;
+    return false;
+}
+
+// Rebuilds the whole term being reduced by putting the focus back into each
+// frame on the path, innermost first.
+TermId Reducer::wholeTerm(TermId term, const vector<Frame> &frames) {
+    for (size_t i = frames.size(); i > 0; i--) {
+        const Frame &frame = frames[i - 1];
+        Term node = store[frame.node];
+
+        switch (frame.type) {
+            case FRAME_APPLY:
+                term = store.Make(APPLICATION, 0, term, node.rTerm);
+                break;
+            case FRAME_ARG:
+                term = store.Make(APPLICATION, 0, frame.term, term);
+                break;
+            case FRAME_ABS:
+                term = store.Make(ABSTRACTION, node.var, term, NIL_TERM);
+                break;
+            case FRAME_TASK:
+                break;
+        }
+    }
+
+    return term;
+}
+
+// Compares two terms node by node, leaving out the names abstractions keep
+// for printing as shapes do.
+bool Reducer::sameTerm(TermId a, TermId b) {
+    vector<pair<TermId, TermId>> pending;
+    pending.push_back({a, b});
+
+    while (!pending.empty()) {
+        TermId left = pending.back().first;
+        TermId right = pending.back().second;
+        pending.pop_back();
+        if (left == right) continue;
+
+        Term l = store[left];
+        Term r = store[right];
+        if (l.type != r.type) return false;
+
+        switch (l.type) {
+            case APPLICATION:
+                pending.push_back({l.rTerm, r.rTerm});
+                pending.push_back({l.lTerm, r.lTerm});
+                break;
+            case ABSTRACTION:
+                pending.push_back({l.lTerm, r.lTerm});
+                break;
+            case NUMERAL:
+                if (l.var != r.var || l.lTerm != r.lTerm) return false;
+                break;
+            default:
+                if (l.var != r.var) return false;
+                break;
+        }
+    }
+
+    return true;
+}
+
+bool Reducer::outgrows(DivergenceCheck &check, size_t live) {
+    check.growing = check.growing && live > check.live;
+    check.live = live;
+    if (!check.growing || live <= liveLimit) return false;
+
+    divergence = "diverges (term grew past " + to_string(liveLimit) +
+                 " terms after " + to_string(stats.betaSteps) + " steps)";
+    return true;
+}
+
+// Called once the head of an application spine is found to be neutral, so
+// that every argument on the spine is independent of the others. Each big
+// enough argument but the first, which this thread goes on to normalise
+// itself, becomes a task, reduced in a fork that does not search the table
+// this thread goes on adding to.
+void Reducer::spawnArguments(vector<Frame> &frames) {
+    if (frames.empty() || frames.back().type != FRAME_APPLY) return;
+
+    for (size_t i = frames.size() - 1;
+         i > 0 && frames[i - 1].type == FRAME_APPLY; i--) {
+        Frame &frame = frames[i - 1];
+        TermId arg = store[frame.node].rTerm;
+        if (!isLarger(arg, cutoff)) continue;
+
+        tasks.emplace_back();
+        ArgumentTask *task = &tasks.back();
+        task->arg = arg;
+        task->fork.reset(new TermStore(store, true));
+        task->task.run = [this, task] {
+            Reducer reducer(*task->fork, symbols, definitions, program,
+                            names, engine, output);
+            reducer.SetParallel(pool, cutoff);
+            reducer.current = current;
+            task->result = reducer.normalize(task->arg);
+            task->stats = reducer.stats;
+        };
+
+        pool->Spawn(&task->task);
+        frame.type = FRAME_TASK;
+        frame.term = tasks.size() - 1;
+    }
+}
+
+// Counts the nodes of term, without looking further than size of them.
+bool Reducer::isLarger(TermId term, size_t size) {
+    vector<TermId> pending;
+    size_t count = 0;
+    pending.push_back(term);
+
+    while (!pending.empty()) {
+        Term t = store[pending.back()];
+        pending.pop_back();
+
+        if (++count >= size) return true;
+        if (t.type == ABSTRACTION || t.type == APPLICATION)
+            pending.push_back(t.lTerm);
+        if (t.type == APPLICATION) pending.push_back(t.rTerm);
+    }
+
+    return false;
+}
+
+TermId Reducer::joinArgument(uint32_t index) {
+    ArgumentTask &task = tasks[index];
+    pool->Wait(&task.task);
+
+    stats.Add(task.stats);
+    TermId result = adopt(*task.fork, task.result);
+    task.fork.reset();
+    return result;
+}
+
+// Copies the terms a fork made into this store. Whatever the fork only read
+// from its base is already here and is shared as it is.
+TermId Reducer::adopt(TermStore &fork, TermId term) {
+    unordered_map<TermId, TermId> copies;
+    vector<Visit> pending;
+    vector<TermId> copied;
+    pending.push_back({term, 0, false});
+
+    while (!pending.empty()) {
+        Visit visit = pending.back();
+        pending.pop_back();
+        Term t = fork[visit.term];
+
+        if (!fork.Owns(visit.term)) {
+            copied.push_back(visit.term);
+            continue;
+        }
+
+        auto known = copies.find(visit.term);
+        if (known != copies.end()) {
+            copied.push_back(known->second);
+            continue;
+        }
+
+        if (!visit.expanded &&
+            (t.type == ABSTRACTION || t.type == APPLICATION)) {
+            pending.push_back({visit.term, 0, true});
+            if (t.type == APPLICATION) pending.push_back({t.rTerm, 0, false});
+            pending.push_back({t.lTerm, 0, false});
+            continue;
+        }
+
+        TermId lTerm = t.lTerm;
+        TermId rTerm = t.rTerm;
+
+        if (t.type == APPLICATION) {
+            rTerm = copied.back();
+            copied.pop_back();
+        }
+        if (t.type == ABSTRACTION || t.type == APPLICATION) {
+            lTerm = copied.back();
+            copied.pop_back();
+        }
+
+        TermId copy = store.Make((TermType)t.type, t.var, lTerm, rTerm);
+        copies[visit.term] = copy;
+        copied.push_back(copy);
+    }
+
+    return copied.back();
+}
+
+// Substitutes termToSub for the variable bound `depth` abstractions above
+// term and lowers the indices of variables bound further out, since the
+// abstraction being applied disappears.
+TermId Reducer::substituteVars(TermId term, uint32_t depth, TermId termToSub) {
+    return mapIndices(term, depth, termToSub, 0);
+}
+
+// Adds shift to every index that points outside of term.
+TermId Reducer::shiftTerm(TermId term, uint32_t shift, uint32_t depth) {
+    if (term == NIL_TERM || shift == 0) return term;
+    return mapIndices(term, depth, NIL_TERM, shift);
+}
+
+// Rebuilds term with the indices that point outside of it either
+// substituted by termToSub or, without one, raised by shift. Terms are never
+// modified in place: only the path down to each changed index is rebuilt and
+// everything else is shared with the original, without being walked if it is
+// closed at its depth. The walk runs on the member stacks, above whatever an
+// enclosing call left on them.
+TermId Reducer::mapIndices(TermId term, uint32_t depth, TermId termToSub,
+                          uint32_t shift) {
+    size_t base = visits.size();
+    visits.push_back({term, depth, false});
+
+    while (visits.size() > base) {
+        Visit visit = visits.back();
+        visits.pop_back();
+        Term t = store[visit.term];
+        TermId lTerm;
+        TermId rTerm;
+
+        if (!visit.expanded && ClosedAt(t, visit.depth)) {
+            results.push_back(visit.term);
+            continue;
+        }
+
+        if (!visit.expanded) {
+            switch (t.type) {
+                case ABSTRACTION:
+                    visits.push_back({visit.term, visit.depth, true});
+                    visits.push_back({t.lTerm, visit.depth + 1, false});
+                    break;
+                case APPLICATION:
+                    visits.push_back({visit.term, visit.depth, true});
+                    visits.push_back({t.rTerm, visit.depth, false});
+                    visits.push_back({t.lTerm, visit.depth, false});
+                    break;
+                case INDEX:
+                    if (termToSub == NIL_TERM && t.var >= visit.depth) {
+                        results.push_back(store.Make(INDEX, t.var + shift,
+                                                     NIL_TERM, NIL_TERM));
+                        stats.shifts++;
+                    } else if (termToSub != NIL_TERM && t.var == visit.depth) {
+                        results.push_back(shiftTerm(termToSub, visit.depth));
+                    } else if (termToSub != NIL_TERM && t.var > visit.depth) {
+                        results.push_back(store.Make(INDEX, t.var - 1,
+                                                     NIL_TERM, NIL_TERM));
+                    } else {
+                        results.push_back(visit.term);
+                    }
+                    break;
+                default:
+                    results.push_back(visit.term);
+                    break;
+            }
+
+            continue;
+        }
+
+        rTerm = NIL_TERM;
+        if (t.type == APPLICATION) {
+            rTerm = results.back();
+            results.pop_back();
+        }
+        lTerm = results.back();
+        results.pop_back();
+
+        if (lTerm == t.lTerm && rTerm == t.rTerm) {
+            results.push_back(visit.term);
+        } else {
+            results.push_back(
+                store.Make((TermType)t.type, t.var, lTerm, rTerm));
+            stats.nodesCopied++;
+        }
+    }
+
+    TermId result = results.back();
+    results.pop_back();
+    return result;
+}
+
+void Reducer::getFreeNames(TermId term,
+                           unordered_map<string_view, bool> &freeNames) {
+    vector<TermId> pending;
+    pending.push_back(term);
+
+    while (!pending.empty()) {
+        Term &t = store[pending.back()];
+        pending.pop_back();
+
+        if (t.type == PRIMARY) freeNames[symbols.Name(t.var)] = true;
+        if (t.type == NUMERAL) continue;
+        if (t.lTerm != NIL_TERM) pending.push_back(t.lTerm);
+        if (t.rTerm != NIL_TERM) pending.push_back(t.rTerm);
+    }
+}
+
+string Reducer::nextFreshName(
+    const unordered_map<string_view, bool> &freeNames,
+    const unordered_map<string_view, int> &bound, int &freshCount) {
+    while (true) {
+        string name = "a" + to_string(freshCount++);
+
+        auto used = bound.find(name);
+        if (freeNames.find(name) == freeNames.end() &&
+            (used == bound.end() || used->second == 0))
+            return name;
+    }
+}
+
+// Names are only given back to bound variables here. An abstraction keeps
+// its source name unless that would capture a free name or shadow an
+// enclosing binder, in which case it gets a fresh one. Names are views of
+// the symbol table or of the fresh names made so far, so none is copied, and
+// a name keeps its count once out of scope so that rebinding it is cheap.
+//
+// The term is written straight into out from an explicit stack of pending
+// terms and punctuation. Left spines and bodies are followed in place, so
+// only arguments and closing text are pushed, and a numeral is written out
+// as the Church numeral it stands for without making its terms.
+void Reducer::printTerm(TermId term, Output &out) {
+    unordered_map<string_view, bool> freeNames;
+    unordered_map<string_view, int> bound;
+    vector<string_view> scope;
+    deque<string> fresh;
+    int freshCount = 0;
+    size_t top = 0;
+
+    auto bind = [&](Symbol var) {
+        string_view name = symbols.Name(var);
+        int &count = bound[name];
+
+        if (count > 0 || freeNames.find(name) != freeNames.end()) {
+            fresh.push_back(nextFreshName(freeNames, bound, freshCount));
+            name = fresh.back();
+            bound[name]++;
+        } else {
+            count++;
+        }
+
+        scope.push_back(name);
+        return name;
+    };
+
+    auto unbind = [&]() {
+        bound[scope.back()]--;
+        scope.pop_back();
+    };
+
+    getFreeNames(term, freeNames);
+    if (printTasks.size() < 64) printTasks.resize(64);
+    PrintTask *tasks = printTasks.data();
+    tasks[top++] = {PRINT_TERM, term};
+
+    while (top > 0) {
+        PrintTask task = tasks[--top];
+
+        if (task.type == PRINT_TEXT_SPACE) {
+            out.Put(' ');
+            continue;
+        } else if (task.type == PRINT_TEXT_OPEN) {
+            out.Put('(');
+            continue;
+        } else if (task.type == PRINT_TEXT_CLOSE) {
+            out.Put(')');
+            continue;
+        } else if (task.type == PRINT_UNBIND) {
+            unbind();
+            continue;
+        }
+
+        term = task.term;
+
+        while (term != NIL_TERM) {
+            if (top + 4 > printTasks.size()) {
+                printTasks.resize(printTasks.size() * 2);
+                tasks = printTasks.data();
+            }
+
+            TermId id = term;
+            Term &t = store[id];
+            term = NIL_TERM;
+
+            switch (t.type) {
+                case ABSTRACTION:
+                    out.Put('!');
+                    out.Write(bind(t.var));
+                    out.Put('.');
+                    tasks[top++] = {PRINT_UNBIND, NIL_TERM};
+                    term = t.lTerm;
+                    break;
+                case APPLICATION:
+                    if (store[t.rTerm].type != PRIMARY &&
+                        store[t.rTerm].type != INDEX) {
+                        tasks[top++] = {PRINT_TEXT_CLOSE, NIL_TERM};
+                        tasks[top++] = {PRINT_TERM, t.rTerm};
+                        tasks[top++] = {PRINT_TEXT_OPEN, NIL_TERM};
+                    } else {
+                        tasks[top++] = {PRINT_TERM, t.rTerm};
+                    }
+                    tasks[top++] = {PRINT_TEXT_SPACE, NIL_TERM};
+
+                    if (store[t.lTerm].type == ABSTRACTION ||
+                        store[t.lTerm].type == NUMERAL) {
+                        tasks[top++] = {PRINT_TEXT_CLOSE, NIL_TERM};
+                        out.Put('(');
+                    }
+                    term = t.lTerm;
+                    break;
+                case PRIMARY:
+                    out.Write(symbols.Name(t.var));
+                    break;
+                case INDEX:
+                    out.Write(scope[scope.size() - 1 - t.var]);
+                    break;
+                case NUMERAL: {
+                    uint64_t num;
+                    if (!store.NumeralValue(id).ToUint64(num))
+                        runtimeError("Numeral too large to expand");
+
+                    string_view fName = bind(names.f);
+                    string_view xName = bind(names.x);
+
+                    out.Put('!');
+                    out.Write(fName);
+                    out.Write(".!");
+                    out.Write(xName);
+                    out.Put('.');
+
+                    for (uint64_t i = 0; i < num; i++) {
+                        if (i > 0) out.Write(" (");
+                        out.Write(fName);
+                    }
+
+                    if (num > 0) out.Put(' ');
+                    out.Write(xName);
+                    for (uint64_t i = 1; i < num; i++) out.Put(')');
+
+                    unbind();
+                    unbind();
+                    break;
+                }
+            }
+        }
+    }
+}
+
+bool Reducer::termToBool(TermId term) {
+    if (term == NIL_TERM) runtimeError("Unable to convert term to bool");
+
+    if (store[term].type == NUMERAL) {
+        if (!store.IsZero(term))
+            runtimeError("Unable to convert term to bool");
+        return false;
+    }
+
+    Term &outerAbs = store[term];
+    if (outerAbs.type != ABSTRACTION ||
+        store[outerAbs.lTerm].type != ABSTRACTION)
+        runtimeError("Unable to convert term to bool");
+
+    Term &body = store[store[outerAbs.lTerm].lTerm];
+    if (body.type != INDEX) runtimeError("Unable to convert term to bool");
+
+    return body.var == 1;
+}
+
+Natural Reducer::termToNum(TermId term) {
+    if (term == NIL_TERM) runtimeError("Unable to convert term to number");
+    if (store[term].type == NUMERAL) return store.NumeralValue(term);
+
+    Term &outerAbs = store[term];
+    if (outerAbs.type != ABSTRACTION ||
+        store[outerAbs.lTerm].type != ABSTRACTION)
+        runtimeError("Unable to convert term to number");
+
+    uint64_t num = 0;
+    Term *t = &store[store[outerAbs.lTerm].lTerm];
+
+    while (t->type == APPLICATION) {
+        Term &primary = store[t->lTerm];
+        if (primary.type != INDEX || primary.var != 1)
+            runtimeError("Unable to convert term to number");
+
+        num++;
+        t = &store[t->rTerm];
+    }
+
+    if (t->type != INDEX || t->var != 0)
+        runtimeError("Unable to convert term to number");
+
+    return num;
+}
\ No newline at end of file
@@ -0,0 +1,200 @@
+#ifndef __REDUCER_H__
+#define __REDUCER_H__
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "bytecode.hh"
+#include "definitions.hh"
+#include "natural.hh"
+#include "output.hh"
+#include "pool.hh"
+#include "stats.hh"
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+typedef enum { PRINT_FUNC = 0, PRINT_NUM, PRINT_BOOL } PrintType;
+typedef enum {
+    ENGINE_SUBST = 0,
+    ENGINE_GRAPH,
+    ENGINE_KRIVINE,
+    ENGINE_VM,
+    ENGINE_OPTIMAL
+} EngineType;
+typedef enum { FRAME_APPLY = 0, FRAME_ARG, FRAME_ABS, FRAME_TASK } FrameType;
+
+// The order a statement is reduced in. STRATEGY_DEFAULT leaves it to the
+// engine; the others pick the engine that implements them: the substitution
+// engine for normal order and the Krivine machine for the rest.
+typedef enum {
+    STRATEGY_DEFAULT = 0,
+    STRATEGY_NORMAL,
+    STRATEGY_CBV,
+    STRATEGY_CBN,
+    STRATEGY_CBNEED
+} Strategy;
+
+// Fewest terms the substitution engine makes before it compacts the store.
+const size_t COLLECT_MIN = 1 << 20;
+
+// Fewest beta steps between two samples of the divergence detector.
+const uint64_t SAMPLE_MIN = 64;
+
+typedef enum {
+    PRINT_TERM = 0,
+    PRINT_TEXT_SPACE,
+    PRINT_TEXT_OPEN,
+    PRINT_TEXT_CLOSE,
+    PRINT_UNBIND
+} PrintTaskType;
+
+// A print statement: the term to reduce, how to print it, the strategy to
+// reduce it with and, once compiled, the address of its bytecode.
+struct Statement {
+    TermId term;
+    PrintType printType;
+    Strategy strategy;
+    uint32_t entry;
+};
+
+struct Frame {
+    FrameType type;
+    TermId node;
+    TermId term;
+};
+
+// An argument of a neutral application being normalised on another thread,
+// in a fork of the store.
+struct ArgumentTask {
+    Task task;
+    TermId arg;
+    unique_ptr<TermStore> fork;
+    TermId result;
+    Stats stats;
+};
+
+// What the divergence detector knows of a reduction so far. Samples are
+// compared with the one saved last, which is replaced at every power of two
+// samples (Brent's cycle detection), so a cycle of any length is found with
+// a single saved shape. term is the whole term that shape was taken of, so a
+// matching shape can be told from a collision. live is how many terms the
+// last collection kept and growing whether that has gone up at every
+// collection.
+struct DivergenceCheck {
+    uint64_t saved = 0;
+    TermId term = NIL_TERM;
+    uint64_t power = 1;
+    uint64_t length = 1;
+    uint64_t nextSample = SAMPLE_MIN;
+    size_t live = 0;
+    bool growing = true;
+};
+
+struct Visit {
+    TermId term;
+    uint32_t depth;
+    bool expanded;
+};
+
+struct PrintTask {
+    PrintTaskType type;
+    TermId term;
+};
+
+// Collects the output of statements reduced out of order and writes it in
+// statement order.
+class OutputQueue {
+   public:
+    OutputQueue(size_t count);
+    void Put(size_t statement, string &out, string err);
+    void WaitTurn(size_t statement);
+    void WriteAll(Output &out);
+
+   private:
+    mutex lock;
+    condition_variable changed;
+    vector<string> outs;
+    vector<string> errs;
+    vector<bool> done;
+    size_t written;
+};
+
+bool FindStrategy(const string &name, Strategy &strategy);
+
+// Reduces statements and renders their results. A reducer only reads the
+// definitions, the compiled program and the terms they refer to, and makes
+// everything else in its own store, so reducers over forked stores can run
+// on separate threads.
+class Reducer {
+   public:
+    Reducer(TermStore &store, SymbolTable &symbols,
+            const Definitions &definitions, Bytecode &program,
+            NumeralNames names, EngineType engine,
+            OutputQueue *output = NULL);
+    void SetParallel(WorkPool *workPool, size_t sizeCutoff);
+    void DetectDivergence(size_t growthLimit);
+    void Reduce(const Statement &statement, size_t index, Output &out);
+    TermId NormalizeDefinition(TermId term, uint64_t stepLimit);
+    uint64_t BetaSteps();
+    const Stats &Statistics();
+
+   private:
+    TermStore &store;
+    SymbolTable &symbols;
+    const Definitions &definitions;
+    NumeralNames names;
+    Bytecode &program;
+    EngineType engine;
+    OutputQueue *output;
+    WorkPool *pool = NULL;
+    size_t cutoff = 0;
+    deque<ArgumentTask> tasks;
+    size_t current = 0;
+    uint64_t stepLimit = UINT64_MAX;
+    bool detect = false;
+    size_t liveLimit = 0;
+    string divergence;
+    Stats stats;
+    vector<Visit> visits;
+    vector<TermId> results;
+    vector<PrintTask> printTasks;
+
+    void runtimeError(string msg);
+    TermId reduce(const Statement &statement);
+    TermId normalize(TermId term);
+    void collect(TermId &term, vector<Frame> &frames, size_t floor,
+                 TermId &saved);
+    bool repeats(DivergenceCheck &check, TermId term,
+                 const vector<Frame> &frames);
+    TermId wholeTerm(TermId term, const vector<Frame> &frames);
+    bool sameTerm(TermId a, TermId b);
+    bool outgrows(DivergenceCheck &check, size_t live);
+    void spawnArguments(vector<Frame> &frames);
+    bool isLarger(TermId term, size_t size);
+    TermId joinArgument(uint32_t index);
+    TermId adopt(TermStore &fork, TermId term);
+    TermId substituteVars(TermId term, uint32_t depth, TermId termToSub);
+    TermId shiftTerm(TermId term, uint32_t shift, uint32_t depth = 0);
+    TermId mapIndices(TermId term, uint32_t depth, TermId termToSub,
+                      uint32_t shift);
+    void getFreeNames(TermId term,
+                      unordered_map<string_view, bool> &freeNames);
+    string nextFreshName(const unordered_map<string_view, bool> &freeNames,
+                         const unordered_map<string_view, int> &bound,
+                         int &freshCount);
+    void printTerm(TermId term, Output &out);
+    bool termToBool(TermId term);
+    Natural termToNum(TermId term);
+};
+
+#endif
@@ -0,0 +1,78 @@
+#include "stats.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <sstream>
+#include <string>
+
+using namespace std;
+
+// Every allocation made with new is counted against the thread making it,
+// so that statements reduced on separate threads are measured separately.
+thread_local uint64_t allocatedBytes = 0;
+
+void *operator new(size_t size) {
+    allocatedBytes += size;
+
+    void *memory = malloc(size == 0 ? 1 : size);
+    if (memory == NULL) throw bad_alloc();
+    return memory;
+}
+
+void operator delete(void *memory) noexcept { free(memory); }
+
+void operator delete(void *memory, size_t size) noexcept { free(memory); }
+
+// Live terms are left to the caller, since they are a level rather than an
+// amount and only the latest one means anything.
+void Stats::Add(const Stats &other) {
+    betaSteps += other.betaSteps;
+    unfoldings += other.unfoldings;
+    shifts += other.shifts;
+    nodesCopied += other.nodesCopied;
+    collections += other.collections;
+    peakTerms = max(peakTerms, other.peakTerms);
+    bytesAllocated += other.bytesAllocated;
+    parseTime += other.parseTime;
+    reduceTime += other.reduceTime;
+    printTime += other.printTime;
+}
+
+string Stats::ToString() const {
+    ostringstream out;
+    out << fixed << setprecision(3) << betaSteps << " beta steps, "
+        << unfoldings << " unfoldings, " << shifts << " shifts, "
+        << nodesCopied << " nodes copied, " << collections
+        << " collections, " << liveTerms << " live terms, "
+        << peakTerms << " peak terms, " << bytesAllocated
+        << " bytes allocated, parse " << parseTime * 1000 << " ms, reduce "
+        << reduceTime * 1000 << " ms, print " << printTime * 1000 << " ms";
+    return out.str();
+}
+
+string Stats::ToJson() const {
+    ostringstream out;
+    out << fixed << setprecision(3) << "{\"beta_steps\": " << betaSteps
+        << ", \"unfoldings\": " << unfoldings << ", \"shifts\": " << shifts
+        << ", \"nodes_copied\": " << nodesCopied
+        << ", \"collections\": " << collections
+        << ", \"live_terms\": " << liveTerms
+        << ", \"peak_terms\": " << peakTerms
+        << ", \"bytes_allocated\": " << bytesAllocated
+        << ", \"parse_ms\": " << parseTime * 1000
+        << ", \"reduce_ms\": " << reduceTime * 1000
+        << ", \"print_ms\": " << printTime * 1000 << "}";
+    return out.str();
+}
+
+uint64_t AllocatedBytes() { return allocatedBytes; }
+
+double Now() {
+    return chrono::duration<double>(
+               chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
\ No newline at end of file
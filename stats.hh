@@ -0,0 +1,36 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+typedef enum { STATS_NONE = 0, STATS_TEXT, STATS_JSON } StatsFormat;
+
+// What reducing a statement, or a whole run, cost. Shifts are De Bruijn
+// index adjustments made while substituting, and nodes copied counts the
+// application and abstraction nodes rebuilt to substitute or instantiate.
+// Collections counts compactions of the term store. Times are in seconds.
+struct Stats {
+    uint64_t betaSteps = 0;
+    uint64_t unfoldings = 0;
+    uint64_t shifts = 0;
+    uint64_t nodesCopied = 0;
+    uint64_t collections = 0;
+    uint64_t liveTerms = 0;
+    uint64_t peakTerms = 0;
+    uint64_t bytesAllocated = 0;
+    double parseTime = 0;
+    double reduceTime = 0;
+    double printTime = 0;
+
+    void Add(const Stats &other);
+    string ToString() const;
+    string ToJson() const;
+};
+
+uint64_t AllocatedBytes();
+double Now();
+
+#endif
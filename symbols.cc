@@ -0,0 +1,29 @@
+#include "symbols.hh"
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+
+Symbol SymbolTable::Intern(string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) return it->second;
+
+    Symbol symbol = names.size();
+    names.emplace_back(name);
+    ids[names.back()] = symbol;
+    return symbol;
+}
+
+const string &SymbolTable::Name(Symbol symbol) { return names[symbol]; }
+
+size_t SymbolTable::Size() { return names.size(); }
+
+void SymbolTable::Truncate(size_t size) {
+    while (names.size() > size) {
+        ids.erase(names.back());
+        names.pop_back();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef __SYMBOLS_H__
+#define __SYMBOLS_H__
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+
+typedef uint32_t Symbol;
+
+// Interns every name into a dense id, so that names are compared, and
+// definitions looked up, by integer. Only parsing adds names; lookups of
+// names already interned may run on several threads at once. The table is
+// keyed by views of the names it keeps, which a deque never moves, so looking
+// up a name makes no copy of it. The names interned since a given size can
+// be dropped again once nothing refers to them.
+class SymbolTable {
+   public:
+    Symbol Intern(string_view name);
+    const string &Name(Symbol symbol);
+    size_t Size();
+    void Truncate(size_t size);
+
+   private:
+    deque<string> names;
+    unordered_map<string_view, Symbol> ids;
+};
+
+#endif
@@ -0,0 +1,376 @@
+#include "term.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+TermStore::TermStore() {
+    base = NULL;
+    searched = NULL;
+    baseNaturals = 0;
+    baseChunks = 0;
+    baseSize = 0;
+    count = 0;
+    peak = 0;
+    hashCons = false;
+    shaping = false;
+    tableCount = 0;
+    New(PRIMARY, 0, NIL_TERM, NIL_TERM);
+}
+
+// A fork starts with a table and numerals of its own that are empty, and
+// finds those of its base through base. The tables it searches after its
+// own start from searched.
+TermStore::TermStore(TermStore &base, bool baseChanges)
+    : chunks(base.chunks), shapes(base.shapes) {
+    this->base = &base;
+    searched = baseChanges ? base.searched : &base;
+    baseNaturals = base.NumeralMark();
+    baseChunks = chunks.size();
+    baseSize = base.Size();
+    count = baseChunks * CHUNK_SIZE;
+    peak = count;
+    hashCons = base.hashCons;
+    shaping = base.shaping;
+    tableCount = 0;
+    if (hashCons) table.assign(1024, NIL_TERM);
+}
+
+TermStore::~TermStore() {
+    for (size_t i = baseChunks; i < chunks.size(); i++) delete[] chunks[i];
+    for (size_t i = baseChunks; i < shapes.size(); i++) delete[] shapes[i];
+}
+
+TermId TermStore::New(TermType type, uint32_t var, TermId lTerm,
+                      TermId rTerm) {
+    if (count > UINT32_MAX) {
+        cout << "RUNTIME ERROR: Term store exhausted\n";
+        exit(1);
+    }
+
+    if (count == chunks.size() * CHUNK_SIZE)
+        chunks.push_back(new Term[CHUNK_SIZE]);
+    if (shaping && count == shapes.size() * CHUNK_SIZE)
+        shapes.push_back(new uint64_t[CHUNK_SIZE]);
+
+    uint16_t loose = 0;
+
+    if (type == INDEX) {
+        loose = var < LOOSE_UNKNOWN ? var + 1 : LOOSE_UNKNOWN;
+    } else if (type == ABSTRACTION) {
+        loose = (*this)[lTerm].loose;
+        if (loose > 0 && loose != LOOSE_UNKNOWN) loose--;
+    } else if (type == APPLICATION) {
+        loose = (*this)[lTerm].loose;
+        uint16_t right = (*this)[rTerm].loose;
+        if (right > loose) loose = right;
+    }
+
+    TermId id = count++;
+    if (count > peak) peak = count;
+    Term &term = (*this)[id];
+    term.type = type;
+    term.loose = loose;
+    term.var = var;
+    term.lTerm = lTerm;
+    term.rTerm = rTerm;
+    if (shaping) shapes[id >> CHUNK_BITS][id & CHUNK_MASK] = shape(term);
+    return id;
+}
+
+void TermStore::EnableHashConsing() {
+    hashCons = true;
+    table.assign(1024, NIL_TERM);
+    tableCount = 0;
+
+    for (TermId id = 1; id < count; id++) insert(id);
+}
+
+// Shapes are filled in for the terms already made, in the order they were
+// made so that children come first.
+void TermStore::EnableShapeHashing() {
+    shaping = true;
+
+    for (TermId id = 0; id < count; id++) {
+        if ((id & CHUNK_MASK) == 0) shapes.push_back(new uint64_t[CHUNK_SIZE]);
+        shapes[id >> CHUNK_BITS][id & CHUNK_MASK] = shape((*this)[id]);
+    }
+}
+
+TermId TermStore::Make(TermType type, uint32_t var, TermId lTerm,
+                       TermId rTerm) {
+    if (!hashCons) return New(type, var, lTerm, rTerm);
+
+    size_t h = hash(type, var, lTerm, rTerm);
+
+    TermId found = find(h, type, var, lTerm, rTerm);
+    if (found != NIL_TERM) return found;
+
+    for (TermStore *store = searched; store != NULL; store = store->searched) {
+        found = store->find(h, type, var, lTerm, rTerm);
+        if (found != NIL_TERM) return found;
+    }
+
+    TermId id = New(type, var, lTerm, rTerm);
+    insert(id);
+    return id;
+}
+
+size_t TermStore::Mark() { return count; }
+
+void TermStore::Release(size_t mark) {
+    if (hashCons)
+        for (size_t id = count; id > mark; id--) remove(id - 1);
+
+    count = mark;
+    freeChunks();
+}
+
+// A term is always made after its children, so one pass down from the top
+// finds every term the roots reach, and one pass up can slide each of them
+// down over the dead ones with its children already moved. The ids of the
+// terms kept after mark change, roots included.
+void TermStore::Compact(size_t mark, vector<TermId> &roots) {
+    vector<TermId> moved(count - mark, NIL_TERM);
+
+    for (size_t i = 0; i < roots.size(); i++)
+        if (roots[i] >= mark) moved[roots[i] - mark] = 1;
+
+    for (size_t id = count; id > mark; id--) {
+        Term &term = (*this)[id - 1];
+        if (moved[id - 1 - mark] == NIL_TERM) continue;
+        if (term.type != ABSTRACTION && term.type != APPLICATION) continue;
+
+        if (term.lTerm >= mark) moved[term.lTerm - mark] = 1;
+        if (term.type == APPLICATION && term.rTerm >= mark)
+            moved[term.rTerm - mark] = 1;
+    }
+
+    if (hashCons)
+        for (size_t id = count; id > mark; id--) remove(id - 1);
+
+    size_t next = mark;
+
+    for (size_t id = mark; id < count; id++) {
+        if (moved[id - mark] == NIL_TERM) continue;
+
+        Term term = (*this)[id];
+        if (term.type == ABSTRACTION || term.type == APPLICATION) {
+            if (term.lTerm >= mark) term.lTerm = moved[term.lTerm - mark];
+            if (term.type == APPLICATION && term.rTerm >= mark)
+                term.rTerm = moved[term.rTerm - mark];
+        }
+
+        (*this)[next] = term;
+        if (shaping) shapes[next >> CHUNK_BITS][next & CHUNK_MASK] = Shape(id);
+        moved[id - mark] = next;
+        if (hashCons) insert(next);
+        next++;
+    }
+
+    for (size_t i = 0; i < roots.size(); i++)
+        if (roots[i] >= mark) roots[i] = moved[roots[i] - mark];
+
+    count = next;
+    freeChunks();
+}
+
+void TermStore::freeChunks() {
+    size_t used = (count + CHUNK_MASK) >> CHUNK_BITS;
+    while (chunks.size() > used && chunks.size() > baseChunks) {
+        delete[] chunks.back();
+        chunks.pop_back();
+    }
+
+    while (shapes.size() > used && shapes.size() > baseChunks) {
+        delete[] shapes.back();
+        shapes.pop_back();
+    }
+}
+
+// A fork counts the terms of its base as well as its own.
+size_t TermStore::Size() {
+    return baseSize + count - baseChunks * CHUNK_SIZE;
+}
+
+size_t TermStore::Peak() {
+    return baseSize + peak - baseChunks * CHUNK_SIZE;
+}
+
+void TermStore::ResetPeak() { peak = count; }
+
+bool TermStore::Owns(TermId id) { return id >= baseChunks * CHUNK_SIZE; }
+
+// Numeral values are only added while parsing, so they are kept for the
+// whole run rather than released with the terms that use them, unless the
+// parser drops a statement it is done with.
+TermId TermStore::MakeNumeral(const Natural &value) {
+    naturals.push_back(value);
+    return Make(NUMERAL, NumeralMark() - 1, 0, NIL_TERM);
+}
+
+size_t TermStore::NumeralMark() { return baseNaturals + naturals.size(); }
+
+void TermStore::ReleaseNumerals(size_t mark) {
+    naturals.resize(mark - baseNaturals);
+}
+
+TermId TermStore::Predecessor(TermId numeral) {
+    Term term = (*this)[numeral];
+    return Make(NUMERAL, term.var, term.lTerm + 1, NIL_TERM);
+}
+
+bool TermStore::IsZero(TermId numeral) {
+    Term term = (*this)[numeral];
+    return natural(term.var).Compare(term.lTerm) == 0;
+}
+
+Natural TermStore::NumeralValue(TermId numeral) {
+    Term term = (*this)[numeral];
+    Natural value = natural(term.var);
+    value.Subtract(term.lTerm);
+    return value;
+}
+
+TermId TermStore::ChurchZero(Symbol f, Symbol x) {
+    TermId body = Make(INDEX, 0, NIL_TERM, NIL_TERM);
+    return Make(ABSTRACTION, f, Make(ABSTRACTION, x, body, NIL_TERM),
+                NIL_TERM);
+}
+
+// Builds !f.!x.f (pred f x). pred is taken to be outside both abstractions,
+// so a bound variable must already be shifted past them.
+TermId TermStore::ChurchSuccessor(TermId pred, Symbol f, Symbol x) {
+    TermId fVar = Make(INDEX, 1, NIL_TERM, NIL_TERM);
+    TermId xVar = Make(INDEX, 0, NIL_TERM, NIL_TERM);
+    TermId body = Make(APPLICATION, 0, Make(APPLICATION, 0, pred, fVar), xVar);
+    body = Make(APPLICATION, 0, fVar, body);
+    return Make(ABSTRACTION, f, Make(ABSTRACTION, x, body, NIL_TERM),
+                NIL_TERM);
+}
+
+// Rewrites a numeral as the outermost layer of its church encoding, with
+// the rest of it still a numeral.
+TermId TermStore::Unfold(TermId numeral, Symbol f, Symbol x) {
+    if (IsZero(numeral)) return ChurchZero(f, x);
+    return ChurchSuccessor(Predecessor(numeral), f, x);
+}
+size_t TermStore::hash(TermType type, uint32_t var, TermId lTerm,
+                       TermId rTerm) {
+    uint64_t h = type;
+    h = h * 0x9E3779B97F4A7C15ULL + var;
+    h = h * 0x9E3779B97F4A7C15ULL + lTerm;
+    h = h * 0x9E3779B97F4A7C15ULL + rTerm;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// A numeral's shape is that of its value and predecessor count rather than
+// of its church encoding, so it only matches numerals made the same way.
+uint64_t TermStore::shape(const Term &term) {
+    uint64_t h = MixHash(term.type + 1, 0);
+
+    switch (term.type) {
+        case ABSTRACTION:
+            return MixHash(h, Shape(term.lTerm));
+        case APPLICATION:
+            return MixHash(MixHash(h, Shape(term.lTerm)), Shape(term.rTerm));
+        case NUMERAL:
+            return MixHash(MixHash(h, term.var), term.lTerm);
+        default:
+            return MixHash(h, term.var);
+    }
+}
+
+// The numerals a fork reads were mostly made by its bases.
+const Natural &TermStore::natural(uint32_t index) {
+    TermStore *store = this;
+    while (index < store->baseNaturals) store = store->base;
+    return store->naturals[index - store->baseNaturals];
+}
+
+// Looks for a term in this store's own table only. Every term of the store
+// reads the same through a fork, so the tables of the bases a fork searches
+// can be searched from it.
+TermId TermStore::find(size_t h, TermType type, uint32_t var, TermId lTerm,
+                       TermId rTerm) {
+    size_t mask = table.size() - 1;
+    size_t slot = h & mask;
+
+    while (table[slot] != NIL_TERM) {
+        Term &term = (*this)[table[slot]];
+        if (term.type == type && term.var == var && term.lTerm == lTerm &&
+            term.rTerm == rTerm)
+            return table[slot];
+        slot = (slot + 1) & mask;
+    }
+
+    return NIL_TERM;
+}
+
+void TermStore::growTable() {
+    vector<TermId> oldTable;
+    oldTable.swap(table);
+    table.assign(oldTable.size() * 2, NIL_TERM);
+    tableCount = 0;
+
+    for (unsigned int i = 0; i < oldTable.size(); i++)
+        if (oldTable[i] != NIL_TERM) insert(oldTable[i]);
+}
+
+void TermStore::insert(TermId id) {
+    if ((tableCount + 1) * 2 > table.size()) growTable();
+
+    Term &term = (*this)[id];
+    size_t mask = table.size() - 1;
+    size_t slot =
+        hash((TermType)term.type, term.var, term.lTerm, term.rTerm) & mask;
+
+    while (table[slot] != NIL_TERM) slot = (slot + 1) & mask;
+
+    table[slot] = id;
+    tableCount++;
+}
+
+// Linear probing removal: later entries of the same cluster are shifted back
+// into the hole so lookups never stop early at an empty slot.
+void TermStore::remove(TermId id) {
+    Term &term = (*this)[id];
+    size_t mask = table.size() - 1;
+    size_t slot =
+        hash((TermType)term.type, term.var, term.lTerm, term.rTerm) & mask;
+
+    while (table[slot] != id) {
+        if (table[slot] == NIL_TERM) return;
+        slot = (slot + 1) & mask;
+    }
+
+    size_t hole = slot;
+    size_t next = hole;
+
+    while (true) {
+        next = (next + 1) & mask;
+        if (table[next] == NIL_TERM) break;
+
+        Term &moved = (*this)[table[next]];
+        size_t home = hash((TermType)moved.type, moved.var, moved.lTerm,
+                           moved.rTerm) &
+                      mask;
+
+        bool stays = (hole <= next) ? (hole < home && home <= next)
+                                    : (hole < home || home <= next);
+        if (stays) continue;
+
+        table[hole] = table[next];
+        hole = next;
+    }
+
+    table[hole] = NIL_TERM;
+    tableCount--;
+}
\ No newline at end of file
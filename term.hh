@@ -0,0 +1,155 @@
+#ifndef __TERM_H__
+#define __TERM_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "natural.hh"
+#include "symbols.hh"
+
+using namespace std;
+
+typedef enum {
+    ABSTRACTION = 0,
+    APPLICATION,
+    PRIMARY,
+    INDEX,
+    NUMERAL
+} TermType;
+
+typedef uint32_t TermId;
+
+const TermId NIL_TERM = 0;
+
+const uint16_t LOOSE_UNKNOWN = UINT16_MAX;
+
+// Terms are stored in De Bruijn form. A bound variable is an INDEX whose var
+// counts the abstractions between it and its binder, a PRIMARY is a free
+// name (definition or unbound variable) and an ABSTRACTION keeps its source
+// name in var only as a hint for printing. An APPLICATION applies lTerm to
+// rTerm. Children are ids into the owning TermStore.
+//
+// A NUMERAL is a church numeral kept as a number: var indexes a value in the
+// store and lTerm counts how many predecessors have been taken of it. It has
+// no children and only becomes an abstraction when unfolded.
+//
+// loose is one more than the largest index that points outside the term, so
+// 0 for a closed term, and is filled in by the store from the children when
+// the term is made. It saturates at LOOSE_UNKNOWN, which says nothing.
+struct Term {
+    uint8_t type;
+    uint16_t loose;
+    uint32_t var;
+    TermId lTerm;
+    TermId rTerm;
+};
+
+static_assert(sizeof(Term) <= 16, "Term must fit in 16 bytes");
+
+// The names the Church form of a numeral binds. The parser interns them once,
+// so that reducers on other threads never add to the symbol table.
+struct NumeralNames {
+    Symbol f;
+    Symbol x;
+};
+
+// Folds value into the running hash h.
+inline uint64_t MixHash(uint64_t h, uint64_t value) {
+    h = (h ^ value) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+// True if no index in term points outside of depth enclosing abstractions.
+inline bool ClosedAt(const Term &term, uint32_t depth) {
+    return term.loose != LOOSE_UNKNOWN && term.loose <= depth;
+}
+
+// Allocates terms in fixed-size chunks so that ids and references stay valid
+// while the store grows. Terms are never freed one by one; everything
+// allocated after a Mark is dropped at once by Release, or everything after
+// it that the given roots no longer reach by Compact, which moves the rest
+// down and so changes their ids.
+//
+// Terms are immutable once made, so subterms may be shared freely. With hash
+// consing enabled, Make returns the existing id for a term equal to one
+// already in the store instead of allocating a new one.
+//
+// With shape hashing enabled, the store also keeps a hash of the structure
+// of every term, made from the shapes of its children when the term is made.
+// It leaves out the names abstractions keep for printing, so terms equal up
+// to renaming bound variables have the same shape.
+//
+// A fork reads every term of its base store in place and allocates its own
+// from the next chunk on, so that several forks can add terms concurrently
+// while the base itself is left alone. Its hash-consing table and numerals
+// only hold what it adds itself, and it searches those of its base after its
+// own. A fork whose base goes on making terms while it lives, as the store
+// of a thread that hands out tasks does, leaves the table of that base alone
+// and only searches those of the bases beyond it, which stay as they are.
+class TermStore {
+   public:
+    TermStore();
+    TermStore(TermStore &base, bool baseChanges = false);
+    ~TermStore();
+    void EnableHashConsing();
+    void EnableShapeHashing();
+    TermId New(TermType type, uint32_t var, TermId lTerm, TermId rTerm);
+    TermId Make(TermType type, uint32_t var, TermId lTerm, TermId rTerm);
+    size_t Mark();
+    void Release(size_t mark);
+    void Compact(size_t mark, vector<TermId> &roots);
+    size_t Size();
+    size_t Peak();
+    void ResetPeak();
+    bool Owns(TermId id);
+    TermId MakeNumeral(const Natural &value);
+    size_t NumeralMark();
+    void ReleaseNumerals(size_t mark);
+    TermId Predecessor(TermId numeral);
+    bool IsZero(TermId numeral);
+    Natural NumeralValue(TermId numeral);
+    TermId ChurchZero(Symbol f, Symbol x);
+    TermId ChurchSuccessor(TermId pred, Symbol f, Symbol x);
+    TermId Unfold(TermId numeral, Symbol f, Symbol x);
+
+    uint64_t Shape(TermId id) {
+        return shapes[id >> CHUNK_BITS][id & CHUNK_MASK];
+    }
+
+    Term &operator[](TermId id) {
+        return chunks[id >> CHUNK_BITS][id & CHUNK_MASK];
+    }
+
+   private:
+    static const int CHUNK_BITS = 16;
+    static const size_t CHUNK_SIZE = (size_t)1 << CHUNK_BITS;
+    static const size_t CHUNK_MASK = CHUNK_SIZE - 1;
+
+    TermStore *base;
+    TermStore *searched;
+    size_t baseNaturals;
+    vector<Term *> chunks;
+    vector<uint64_t *> shapes;
+    size_t baseChunks;
+    size_t baseSize;
+    size_t count;
+    size_t peak;
+    bool hashCons;
+    bool shaping;
+    vector<TermId> table;
+    size_t tableCount;
+    vector<Natural> naturals;
+
+    size_t hash(TermType type, uint32_t var, TermId lTerm, TermId rTerm);
+    uint64_t shape(const Term &term);
+    const Natural &natural(uint32_t index);
+    TermId find(size_t h, TermType type, uint32_t var, TermId lTerm,
+                TermId rTerm);
+    void freeChunks();
+    void growTable();
+    void insert(TermId id);
+    void remove(TermId id);
+};
+
+#endif
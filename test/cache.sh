@@ -0,0 +1,53 @@
+#!/bin/sh
+# Checks that a module cache is made again when its source changes and when
+# it is corrupt. Run from the repository root after make.
+
+lambda=$(pwd)/lambda
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+cd "$dir" || exit 1
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+check() {
+    result=$("$lambda" main.lmb 2>&1)
+    [ "$result" = "$2" ] || fail "$1: printed '$result', expected '$2'"
+}
+
+printf 'import mod.lmh;\nprint pick a b;\n' > main.lmb
+echo 'let pick = !x.!y.x;' > mod.lmh
+check "first run" a
+[ -f mod.lmhc ] || fail "no cache written"
+check "cached run" a
+
+# A longer source.
+echo 'let pick = !x.!y.y; let other = !x.x;' > mod.lmh
+check "source grew" b
+
+# The same size, so only the contents tell.
+echo 'let pick = !x.!y.x; let other = !y.y;' > mod.lmh
+check "source rewritten to the same size" a
+
+# A cache cut short, then one of garbage.
+head -c 12 mod.lmhc > cut && mv cut mod.lmhc
+check "truncated cache" a
+check "cache made again after truncation" a
+echo 'LMHC not a cache' > mod.lmhc
+check "corrupt cache" a
+check "cache made again after corruption" a
+grep -q 'not a cache' mod.lmhc && fail "corrupt cache not replaced"
+
+# A well-formed cache whose definition points past its binders: pick is
+# stored as !x.!y.x, whose one index is made to skip one binder too many.
+echo 'let pick = !x.!y.x;' > mod.lmh
+check "short source" a
+at=$(grep -obUaP '\x03\x01\x00\x00\x01' mod.lmhc | cut -d: -f1)
+[ -n "$at" ] || fail "index of pick not found in the cache"
+printf '\002' | dd of=mod.lmhc bs=1 seek=$((at + 1)) conv=notrunc 2>/dev/null
+check "cache with an unbound index" a
+check "cache made again after an unbound index" a
+
+echo "cache: ok"
@@ -0,0 +1,70 @@
+#!/bin/sh
+# Runs test/deep.lmb and parses, reduces, prints and reads back terms from
+# sources nested a million deep, checking each result. Run from the
+# repository root after make.
+
+lambda=$(pwd)/lambda
+deep=1000000
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+# Writes text count times.
+repeat() {
+    yes "$1" | head -n "$2" | tr -d '\n'
+}
+
+# The church numeral deep as printed: !a.!b.a (a (... (a b)...)).
+{
+    printf '!a.!b.'
+    repeat 'a (' $((deep - 1))
+    printf 'a b'
+    repeat ')' $((deep - 1))
+    echo
+} > "$dir/numeral"
+
+"$lambda" test/deep.lmb > "$dir/out" 2>&1 || fail "test/deep.lmb failed"
+sed -n 1p "$dir/out" | cmp -s - "$dir/numeral" ||
+    fail "print add: not the numeral $deep"
+[ "$(sed -n 2p "$dir/out")" = $deep ] || fail "printnum add"
+sed -n 3p "$dir/out" | cmp -s - "$dir/numeral" ||
+    fail "print succ: not the numeral $deep"
+[ "$(sed -n 4p "$dir/out")" = 100000 ] || fail "printnum pred"
+
+# A numeral written out in full, parsed and read back.
+{
+    printf 'printnum !f.!x.'
+    repeat 'f (' $deep
+    printf 'x'
+    repeat ')' $deep
+    echo ';'
+} > "$dir/numeral.lmb"
+[ "$("$lambda" "$dir/numeral.lmb" 2>&1)" = $deep ] ||
+    fail "parsing a written out numeral"
+
+# Parentheses nested around a variable.
+{
+    printf 'print '
+    repeat '(' $deep
+    printf 'x'
+    repeat ')' $deep
+    echo ';'
+} > "$dir/parens.lmb"
+[ "$("$lambda" "$dir/parens.lmb" 2>&1)" = x ] ||
+    fail "parsing nested parentheses"
+
+# Abstractions nested around their first binder, which printing renames.
+{
+    printf 'print (!y.'
+    repeat '!a.' $deep
+    echo 'y) z;'
+} > "$dir/binders.lmb"
+"$lambda" "$dir/binders.lmb" > "$dir/out" 2>&1 || fail "nested binders failed"
+[ "$(head -c 12 "$dir/out")" = '!a.!a0.!a1.!' ] || fail "nested binders"
+grep -q '\.z$' "$dir/out" || fail "nested binders: z not substituted"
+
+echo "deep: ok"
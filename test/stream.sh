@@ -0,0 +1,49 @@
+#!/bin/bash
+# Checks that a program piped in on standard input is read, and that with
+# --stream each result is printed in order as soon as its statement is in.
+# Run from the repository root after make.
+
+lambda=$(pwd)/lambda
+dir=$(mktemp -d)
+trap 'exec 3>&- 4<&-; rm -rf "$dir"' EXIT
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+program='import math;
+let pair = !a.!b.!f.f a b;
+printnum add 2 3;
+print pair x y;
+printnum pred 10;
+print (!x.x x) y;'
+expected='5
+!f.f x y
+9
+y y'
+
+for flags in "" "--stream" "-j2" "--engine=krivine --stream"; do
+    result=$(echo "$program" | "$lambda" $flags - 2>&1)
+    [ "$result" = "$expected" ] ||
+        fail "piped with '$flags': printed '$result', expected '$expected'"
+done
+
+# Feed the statements one at a time, reading each result before the next
+# statement is written.
+mkfifo "$dir/in" "$dir/out"
+"$lambda" --stream - < "$dir/in" > "$dir/out" 2>&1 &
+exec 3> "$dir/in" 4< "$dir/out"
+
+echo 'import math;' >&3
+for n in 1 2 3 4 5; do
+    echo "printnum add $n $n;" >&3
+    read -r -t 10 line <&4 || fail "no result for statement $n while streaming"
+    [ "$line" = $((n + n)) ] ||
+        fail "statement $n: printed '$line', expected $((n + n))"
+done
+
+exec 3>&-
+wait $! || fail "streaming run failed"
+
+echo "stream: ok"
@@ -0,0 +1,30 @@
+#!/bin/sh
+# Builds lambda with ThreadSanitizer and checks that reducing in parallel,
+# with and without hash consing and -j, and with the optimal engine,
+# reports no data race and prints what a sequential run does. Run from the
+# repository root.
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+fail() {
+    echo "FAIL: $1"
+    exit 1
+}
+
+g++ -g -O1 -fsanitize=thread -pthread -w *.cc -o "$dir/lambda" ||
+    fail "could not build with -fsanitize=thread"
+
+./lambda test/parallel.lmb > "$dir/expected" 2>&1 || fail "sequential run failed"
+
+for flags in "--hash-cons --parallel=4 --parallel-cutoff=2" \
+    "--parallel=4 --parallel-cutoff=2" \
+    "-j2 --hash-cons --parallel=3 --parallel-cutoff=2" \
+    "--engine=optimal --parallel=3"; do
+    TSAN_OPTIONS="halt_on_error=1 exitcode=66" \
+        "$dir/lambda" $flags test/parallel.lmb > "$dir/out" 2>&1 ||
+        fail "$flags: $(grep -m1 WARNING "$dir/out")"
+    cmp -s "$dir/out" "$dir/expected" || fail "$flags: results differ"
+done
+
+echo "tsan: ok"
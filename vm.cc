@@ -0,0 +1,99 @@
+#include "vm.hh"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+using namespace std;
+
+VirtualMachine::VirtualMachine(Bytecode &program, TermStore &store)
+    : LazyMachine(store, PASS_BY_NEED), program(program) {
+    zeroCode = program.ZeroCode();
+    successorCode = program.SuccessorCode();
+}
+
+TermId VirtualMachine::Run(uint32_t entry) {
+    shared.assign(program.GlobalCount(), NULL);
+    TermId result = readBack(eval(entry, NULL));
+
+    clear();
+    return result;
+}
+
+Value *VirtualMachine::eval(uint32_t pc, Env *env) {
+    size_t base = stack.size();
+    Value *value = NULL;
+
+    while (true) {
+        if (allocated >= collectAt) collect(env, value);
+
+        if (value == NULL) {
+            uint32_t operand = program[pc + 1];
+
+            switch ((Opcode)program[pc]) {
+                case OP_APPLY: {
+                    Thunk *thunk = program[operand] == OP_ACCESS
+                                       ? lookup(env, program[operand + 1])
+                                       : newThunk(operand, env, NULL);
+                    stack.push_back({K_ARG, thunk, NULL});
+                    pc += INSTRUCTION_SIZE;
+                    continue;
+                }
+                case OP_GRAB:
+                    if (stack.size() > base && stack.back().type == K_ARG) {
+                        env = newEnv(stack.back().thunk, env);
+                        stack.pop_back();
+                        pc += INSTRUCTION_SIZE;
+                        stats.betaSteps++;
+                        continue;
+                    }
+
+                    value = newClosure(pc + INSTRUCTION_SIZE, operand, env);
+                    break;
+                case OP_ACCESS: {
+                    Thunk *thunk = lookup(env, operand);
+                    if (thunk->value != NULL) {
+                        value = thunk->value;
+                    } else {
+                        stack.push_back({K_UPDATE, thunk, NULL});
+                        pc = thunk->term;
+                        env = thunk->env;
+                        continue;
+                    }
+                    break;
+                }
+                case OP_GLOBAL: {
+                    if (shared[operand] == NULL)
+                        shared[operand] =
+                            newThunk(program.Global(operand), NULL, NULL);
+
+                    Thunk *thunk = shared[operand];
+                    if (thunk->value != NULL) {
+                        value = thunk->value;
+                    } else {
+                        stack.push_back({K_UPDATE, thunk, NULL});
+                        pc = thunk->term;
+                        env = NULL;
+                        stats.unfoldings++;
+                        continue;
+                    }
+                    break;
+                }
+                case OP_FREE:
+                    value = newNeutral(true, operand, NULL);
+                    break;
+                case OP_NUMERAL:
+                    if (stack.size() > base && stack.back().type == K_ARG) {
+                        pc = unfold(operand, env);
+                        continue;
+                    }
+
+                    value = newNumeral(operand);
+                    break;
+            }
+        }
+
+        if (stack.size() == base) return value;
+        resume(value, pc, env);
+    }
+}
\ No newline at end of file
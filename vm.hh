@@ -0,0 +1,30 @@
+#ifndef __VM_H__
+#define __VM_H__
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "bytecode.hh"
+#include "krivine.hh"
+#include "stats.hh"
+#include "symbols.hh"
+#include "term.hh"
+
+using namespace std;
+
+// Runs compiled bytecode on the lazy Krivine machine. Environments, thunks
+// and values are those of KrivineMachine, except that a thunk or closure
+// holds the address of its code in place of a term id.
+class VirtualMachine : public LazyMachine {
+   public:
+    VirtualMachine(Bytecode &program, TermStore &store);
+    TermId Run(uint32_t entry);
+
+   private:
+    Bytecode &program;
+
+    Value *eval(uint32_t pc, Env *env);
+};
+
+#endif